@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#include "webrtc_delay_estimation.h"
+
+#include "test_tools.h"
+
+TEST_CASE("reusing a context should remove the setup cost of short clips", "[benchmark]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr size_t kNumChannels = 1;
+  constexpr int kSampleRateHz = 16000;
+  constexpr size_t kSampleSize = kSampleRateHz / 10;
+  constexpr size_t kDelay = 800;
+
+  std::vector<float> render(kSampleSize);
+  RandomizeSampleVector(render);
+  std::vector<float> capture(kSampleSize + kDelay, 0.0f);
+  std::copy(render.begin(), render.end(), std::next(capture.begin(), kDelay));
+
+  WavFileInfo render_info;
+  render_info.num_channels = kNumChannels;
+  render_info.sample_rate = kSampleRateHz;
+  render_info.samples = render;
+  WavFileInfo capture_info;
+  capture_info.num_channels = kNumChannels;
+  capture_info.sample_rate = kSampleRateHz;
+  capture_info.samples = capture;
+
+  Setting setting;
+  setting.down_sampling_factor = 8;
+  setting.num_filters = 10;
+
+  BENCHMARK("setting up a new estimator") {
+    DelayEstimator estimator(kSampleRateHz, kNumChannels, kNumChannels,
+                             setting);
+    return estimator.HasEstimate();
+  };
+
+  EstimatorContext context;
+  BENCHMARK("resetting the estimator of a context") {
+    return context
+        .Acquire(kSampleRateHz, kNumChannels, kNumChannels, setting)
+        .HasEstimate();
+  };
+
+  // Clips this short may end before an estimate is available, in which case
+  // both variants process the whole clip.
+  BENCHMARK("estimating 100 ms with a new estimator") {
+    try {
+      return EstimateDelay(render_info, capture_info, setting);
+    } catch (NoEstimateAvailableError* e) {
+      delete e;
+      return size_t{0};
+    }
+  };
+
+  BENCHMARK("estimating 100 ms with a reused context") {
+    try {
+      return EstimateDelay(render_info, capture_info, setting, context);
+    } catch (NoEstimateAvailableError* e) {
+      delete e;
+      return size_t{0};
+    }
+  };
+}
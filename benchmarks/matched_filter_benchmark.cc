@@ -0,0 +1,352 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#include "aec3_common.h"
+#include "apm_data_dumper.h"
+#include "cpu_features_wrapper.h"
+#include "decimator.h"
+#include "downsampled_render_buffer.h"
+#include "matched_filter.h"
+#include "matched_filter_lag_aggregator.h"
+
+#include "webrtc_delay_estimation.h"
+
+#include "test_tools.h"
+
+TEST_CASE("matched filter cost should scale with the number of filters", "[benchmark]") {
+  using namespace webrtc;
+
+  constexpr size_t kDownSamplingFactor = 8;
+  constexpr size_t kSubBlockSize = kBlockSize / kDownSamplingFactor;
+  constexpr int kNumFilters[] = {5, 10, 20, 40, 80, 160, 320};
+
+  ApmDataDumper data_dumper(0);
+  std::vector<float> capture(kSubBlockSize);
+  RandomizeSampleVector(capture);
+
+  for (auto num_filters : kNumFilters) {
+    MatchedFilter filter(&data_dumper, DetectOptimization(), kSubBlockSize,
+                         kMatchedFilterWindowSizeSubBlocks, num_filters,
+                         kMatchedFilterAlignmentShiftSizeSubBlocks, 150.f,
+                         0.7f, 0.2f, 1);
+    DownsampledRenderBuffer render_buffer(
+        GetDownSampledBufferSize(kDownSamplingFactor, num_filters));
+    RandomizeSampleVector(render_buffer.buffer);
+
+    BENCHMARK("updating " + std::to_string(num_filters) + " filters") {
+      render_buffer.UpdateReadIndex(-static_cast<int>(kSubBlockSize));
+      filter.Update(render_buffer, capture);
+      return filter.GetLagEstimates()[0].accuracy;
+    };
+  }
+}
+
+TEST_CASE("matched filter split between threads should be faster than one thread", "[benchmark]") {
+  using namespace webrtc;
+
+  constexpr size_t kDownSamplingFactor = 4;
+  constexpr size_t kSubBlockSize = kBlockSize / kDownSamplingFactor;
+  constexpr int kNumFilters[] = {40, 160};
+  constexpr size_t kNumThreads[] = {1, 2, 4};
+
+  ApmDataDumper data_dumper(0);
+  std::vector<float> capture(kSubBlockSize);
+  RandomizeSampleVector(capture);
+
+  for (auto num_filters : kNumFilters) {
+    DownsampledRenderBuffer render_buffer(
+        GetDownSampledBufferSize(kDownSamplingFactor, num_filters));
+    RandomizeSampleVector(render_buffer.buffer);
+
+    for (auto num_threads : kNumThreads) {
+      MatchedFilter filter(&data_dumper, DetectOptimization(), kSubBlockSize,
+                           kMatchedFilterWindowSizeSubBlocks, num_filters,
+                           kMatchedFilterAlignmentShiftSizeSubBlocks, 150.f,
+                           0.7f, 0.2f, num_threads);
+
+      BENCHMARK("updating " + std::to_string(num_filters) + " filters on " +
+                std::to_string(num_threads) + " threads") {
+        render_buffer.UpdateReadIndex(-static_cast<int>(kSubBlockSize));
+        filter.Update(render_buffer, capture);
+        return filter.GetLagEstimates()[0].accuracy;
+      };
+    }
+  }
+}
+
+TEST_CASE("AVX-512 matched filter core should be faster than the AVX2 one", "[benchmark]") {
+  using namespace webrtc;
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+  if (GetCPUInfo(kAVX512F) == 0)
+    return;
+
+  constexpr size_t kDownSamplingFactors[] = {2, 4, 8};
+
+  for (auto factor : kDownSamplingFactors) {
+    const size_t sub_block_size = kBlockSize / factor;
+    std::vector<float> x(2 * GetDownSampledBufferSize(factor, 10));
+    RandomizeSampleVector(x);
+    std::vector<float> y(sub_block_size);
+    RandomizeSampleVector(y);
+    std::vector<float> h(kMatchedFilterWindowSizeSubBlocks * sub_block_size);
+
+    // A zero threshold updates the filter on every sample, which is the most
+    // expensive case.
+    BENCHMARK("AVX2 core at a down sampling factor of " +
+              std::to_string(factor)) {
+      bool filters_updated = false;
+      float error_sum = 0.f;
+      aec3::MatchedFilterCore_AVX2(0, 0.f, 0.7f, x, y, h, &filters_updated,
+                                   &error_sum);
+      return error_sum;
+    };
+
+    BENCHMARK("AVX-512 core at a down sampling factor of " +
+              std::to_string(factor)) {
+      bool filters_updated = false;
+      float error_sum = 0.f;
+      aec3::MatchedFilterCore_AVX512(0, 0.f, 0.7f, x, y, h, &filters_updated,
+                                     &error_sum);
+      return error_sum;
+    };
+  }
+#endif
+}
+
+TEST_CASE("matched filter bank core should be faster than separate cores", "[benchmark]") {
+  using namespace webrtc;
+
+  constexpr size_t kDownSamplingFactors[] = {2, 4, 8};
+  constexpr size_t kNumFilters = 10;
+
+  for (auto factor : kDownSamplingFactors) {
+    const size_t sub_block_size = kBlockSize / factor;
+    const size_t h_size = kMatchedFilterWindowSizeSubBlocks * sub_block_size;
+    const size_t filter_shift =
+        kMatchedFilterAlignmentShiftSizeSubBlocks * sub_block_size;
+    std::vector<float> x(2 * GetDownSampledBufferSize(factor, kNumFilters));
+    RandomizeSampleVector(x);
+    std::vector<float> y(sub_block_size);
+    RandomizeSampleVector(y);
+    AlignedFilterCoefficients h(kNumFilters * h_size);
+
+    BENCHMARK("separate cores at a down sampling factor of " +
+              std::to_string(factor)) {
+      bool filters_updated[kNumFilters] = {};
+      float error_sums[kNumFilters] = {};
+      for (size_t n = 0; n < kNumFilters; n++) {
+        aec3::MatchedFilterCore(n * filter_shift, 0.f, 0.7f, x, y,
+                                h.View().subview(n * h_size, h_size),
+                                &filters_updated[n], &error_sums[n]);
+      }
+      return error_sums[0];
+    };
+
+    BENCHMARK("bank core at a down sampling factor of " +
+              std::to_string(factor)) {
+      bool filters_updated[kNumFilters] = {};
+      float error_sums[kNumFilters] = {};
+      float x2_sums[kNumFilters];
+      aec3::MatchedFilterBankCore(0, filter_shift, 0.f, 0.7f, x, y, h.View(),
+                                  filters_updated, error_sums, x2_sums);
+      return error_sums[0];
+    };
+  }
+}
+
+TEST_CASE("specialized matched filter bank cores should be faster than the run time sized ones", "[benchmark]") {
+  using namespace webrtc;
+
+  constexpr size_t kDownSamplingFactors[] = {2, 4, 8};
+  constexpr size_t kNumFilters = 10;
+  const Aec3Optimization optimization = DetectOptimization();
+
+  for (auto factor : kDownSamplingFactors) {
+    const size_t sub_block_size = kBlockSize / factor;
+    const size_t h_size = kMatchedFilterWindowSizeSubBlocks * sub_block_size;
+    const size_t filter_shift =
+        kMatchedFilterAlignmentShiftSizeSubBlocks * sub_block_size;
+    std::vector<float> x(2 * GetDownSampledBufferSize(factor, kNumFilters));
+    RandomizeSampleVector(x);
+    std::vector<float> y(sub_block_size);
+    RandomizeSampleVector(y);
+    AlignedFilterCoefficients h(kNumFilters * h_size);
+
+    const aec3::MatchedFilterBankCoreFunction generic_core =
+        aec3::SelectMatchedFilterBankCore(optimization, 0, 0, 0);
+    const aec3::MatchedFilterBankCoreFunction specialized_core =
+        aec3::SelectMatchedFilterBankCore(optimization, sub_block_size, h_size,
+                                          filter_shift);
+
+    BENCHMARK("run time sized core at a down sampling factor of " +
+              std::to_string(factor)) {
+      std::array<bool, kNumFilters> filters_updated = {};
+      std::array<float, kNumFilters> error_sums = {};
+      std::array<float, kNumFilters> x2_sums;
+      generic_core(0, filter_shift, 0.f, 0.7f, x, y, h.View(),
+                   filters_updated, error_sums, x2_sums);
+      return error_sums[0];
+    };
+
+    BENCHMARK("specialized core at a down sampling factor of " +
+              std::to_string(factor)) {
+      std::array<bool, kNumFilters> filters_updated = {};
+      std::array<float, kNumFilters> error_sums = {};
+      std::array<float, kNumFilters> x2_sums;
+      specialized_core(0, filter_shift, 0.f, 0.7f, x, y, h.View(),
+                       filters_updated, error_sums, x2_sums);
+      return error_sums[0];
+    };
+  }
+}
+
+TEST_CASE("optimized peak search should be faster than the generic one", "[benchmark]") {
+  using namespace webrtc;
+
+  constexpr size_t kDownSamplingFactors[] = {2, 4, 8};
+  const aec3::MaxSquarePeakIndexFunction optimized_peak_index =
+      aec3::SelectMaxSquarePeakIndex(DetectOptimization());
+
+  for (auto factor : kDownSamplingFactors) {
+    const size_t sub_block_size = kBlockSize / factor;
+    std::vector<float> h(kMatchedFilterWindowSizeSubBlocks * sub_block_size);
+    RandomizeSampleVector(h);
+
+    BENCHMARK("generic peak search at a down sampling factor of " +
+              std::to_string(factor)) {
+      return aec3::MaxSquarePeakIndex(h);
+    };
+
+    BENCHMARK("optimized peak search at a down sampling factor of " +
+              std::to_string(factor)) {
+      return optimized_peak_index(h);
+    };
+  }
+}
+
+TEST_CASE("optimized decimator should be faster than the generic one", "[benchmark]") {
+  using namespace webrtc;
+
+  constexpr size_t kDownSamplingFactors[] = {2, 4, 8};
+
+  std::vector<float> x(kBlockSize);
+  RandomizeSampleVector(x);
+
+  for (auto factor : kDownSamplingFactors) {
+    Decimator generic_decimator(Aec3Optimization::kNone, factor, false);
+    Decimator optimized_decimator(DetectOptimization(), factor, false);
+    std::vector<float> out(kBlockSize / factor);
+
+    BENCHMARK("generic decimator at a down sampling factor of " +
+              std::to_string(factor)) {
+      generic_decimator.Decimate(x, out);
+      return out[0];
+    };
+
+    BENCHMARK("optimized decimator at a down sampling factor of " +
+              std::to_string(factor)) {
+      optimized_decimator.Decimate(x, out);
+      return out[0];
+    };
+  }
+}
+
+TEST_CASE("FIR decimator should be faster than the biquads at high down sampling factors", "[benchmark]") {
+  using namespace webrtc;
+
+  constexpr size_t kDownSamplingFactors[] = {2, 4, 8};
+
+  std::vector<float> x(kBlockSize);
+  RandomizeSampleVector(x);
+
+  for (auto factor : kDownSamplingFactors) {
+    Decimator biquad_decimator(DetectOptimization(), factor, false);
+    Decimator fir_decimator(DetectOptimization(), factor, true);
+    std::vector<float> out(kBlockSize / factor);
+
+    BENCHMARK("biquad decimator at a down sampling factor of " +
+              std::to_string(factor)) {
+      biquad_decimator.Decimate(x, out);
+      return out[0];
+    };
+
+    BENCHMARK("FIR decimator at a down sampling factor of " +
+              std::to_string(factor)) {
+      fir_decimator.Decimate(x, out);
+      return out[0];
+    };
+  }
+}
+
+TEST_CASE("lag aggregation cost should not depend on the maximum lag", "[benchmark]") {
+  using namespace webrtc;
+
+  constexpr size_t kMaxFilterLags[] = {1000, 10000, 100000};
+  const EchoCanceller3Config::Delay::DelaySelectionThresholds kThresholds = {
+      5, 20};
+
+  ApmDataDumper data_dumper(0);
+  for (auto max_filter_lag : kMaxFilterLags) {
+    MatchedFilterLagAggregator aggregator(&data_dumper, max_filter_lag,
+                                          kThresholds, false);
+
+    // Most votes go to the same lag, as they do once the delay is found.
+    std::array<MatchedFilter::LagEstimate, 1> lag_estimates;
+    size_t block = 0;
+    BENCHMARK("aggregating with a maximum lag of " +
+              std::to_string(max_filter_lag)) {
+      const size_t lag = block % 4 == 0 ? block % max_filter_lag : 500;
+      lag_estimates[0] = MatchedFilter::LagEstimate(1.f, true, lag, true);
+      ++block;
+      return aggregator.Aggregate(lag_estimates).has_value();
+    };
+  }
+}
+
+TEST_CASE("delay estimation cost should scale with the number of filters", "[benchmark]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr size_t kNumChannels = 1;
+  constexpr int kSampleRateHz = 16000;
+  constexpr size_t kSampleSize = 5 * kSampleRateHz;
+  constexpr size_t kNumFilters[] = {10, 40, 160};
+
+  std::vector<float> render(kSampleSize);
+  RandomizeSampleVector(render);
+
+  // Delay the capture signal by 1.5 seconds
+  constexpr size_t kDelay = 24000;
+  std::vector<float> capture(kSampleSize + kDelay, 0.0f);
+  std::copy(render.begin(), render.end(), std::next(capture.begin(), kDelay));
+
+  WavFileInfo render_info;
+  render_info.num_channels = kNumChannels;
+  render_info.sample_rate = kSampleRateHz;
+  render_info.samples = render;
+  WavFileInfo capture_info;
+  capture_info.num_channels = kNumChannels;
+  capture_info.sample_rate = kSampleRateHz;
+  capture_info.samples = capture;
+
+  for (auto num_filters : kNumFilters) {
+    Setting setting;
+    setting.down_sampling_factor = 8;
+    setting.num_filters = num_filters;
+
+    BENCHMARK("estimating 5 seconds with " + std::to_string(num_filters) +
+              " filters") {
+      try {
+        return EstimateDelay(render_info, capture_info, setting);
+      } catch (NoEstimateAvailableError* e) {
+        delete e;
+        return size_t{0};
+      }
+    };
+  }
+}
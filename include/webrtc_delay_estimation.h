@@ -3,6 +3,7 @@
 
 #include <cstddef>
 #include <exception>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -36,16 +37,188 @@ struct WavFileInfo {
  * Structure that holds setting information.
  */
 struct Setting {
-  
+
+  /**
+   * Algorithm EstimateDelay uses. The matched filter bank follows the delay
+   * block by block, as WebRTC does. The generalized cross-correlation with
+   * phase transform weighting (GCC-PHAT) instead correlates the whole input at
+   * once with large FFTs, which is faster on long recordings with a constant
+   * delay and gives the delay to the sample at the input sample rate.
+   *
+   * EstimateDelayTimeline and DelayEstimator always use the matched filters.
+   */
+  enum class Engine { kMatchedFilter, kGccPhat };
+
   /**
    * Down sampling factor to use when estimating.
    */
   size_t down_sampling_factor;
 
   /**
-   * Number of filters to apply when estimating.
+   * Number of filters to apply when estimating. GCC-PHAT searches the same
+   * range of delays as this many filters cover.
    */
   size_t num_filters;
+
+  /**
+   * Down sampling factor of an optional second search stage. Once the delay
+   * found with down_sampling_factor has settled, a few filters at this finer
+   * factor are centered on it to refine the estimate. Must be 2 or 4 and lower
+   * than down_sampling_factor. Zero disables the second stage. With the second
+   * stage, estimates are only refined once it has found the delay, and until
+   * then the first stage estimate is reported as a coarse one.
+   */
+  size_t fine_down_sampling_factor = 0;
+
+  /**
+   * Number of filters used by the second search stage.
+   */
+  size_t num_fine_filters = 2;
+
+  /**
+   * Once a refined delay is found, only the filters that cover it are updated,
+   * which lowers the cost of long inputs several times. All the filters are
+   * still updated every this many blocks, so a change of the delay is detected
+   * about this many times slower. Zero updates all the filters on every block.
+   */
+  size_t steady_state_probe_interval_blocks = 0;
+
+  /**
+   * Number of threads that update the filters of the first search stage,
+   * including the calling one. The extra threads spin for about a millisecond
+   * while they wait for the next block, and then sleep until it comes, so this
+   * only pays off with many filters and idle cores.
+   */
+  size_t num_filter_threads = 1;
+
+  /**
+   * Maximum number of delay candidates DelayEstimator::GetCandidates returns,
+   * for inputs with several echo paths. Every filter that explains at least a
+   * tenth of the capture energy with a clear peak then votes for the delay it
+   * finds on every block. Zero disables the candidates.
+   */
+  size_t num_delay_candidates = 0;
+
+  /**
+   * Whether the matched filters are fed by linear-phase FIR decimators, which
+   * only compute the samples they keep, instead of the cascades of biquads
+   * WebRTC uses. This is cheaper at the higher down sampling factors.
+   */
+  bool use_fir_decimator = false;
+
+  /**
+   * Number of blocks a refined estimate has to stay unchanged before
+   * EstimateDelay stops processing the rest of the input, which with
+   * fine_down_sampling_factor has to be an estimate of the second stage. Zero
+   * processes the entire input. GCC-PHAT always processes the entire input.
+   */
+  size_t stable_blocks_to_stop = 0;
+
+  /**
+   * Maximum amount of audio, in seconds, EstimateDelay processes. Zero
+   * processes the entire input.
+   */
+  float max_duration_seconds = 0.f;
+
+  /**
+   * Algorithm to use when estimating.
+   */
+  Engine engine = Engine::kMatchedFilter;
+};
+
+/**
+ * Structure that holds a single delay estimate.
+ */
+struct DelayEstimate {
+
+  /**
+   * Quality of the estimate. Coarse estimates are reported before the
+   * estimator has settled on a candidate, refined estimates after.
+   */
+  enum class Quality { kCoarse, kRefined };
+
+  /**
+   * Estimated delay in samples at the input sample rate.
+   */
+  size_t delay;
+
+  /**
+   * Quality of the estimated delay.
+   */
+  Quality quality;
+
+  /**
+   * Number of blocks processed since the estimated delay last changed.
+   */
+  size_t blocks_since_last_change;
+};
+
+/**
+ * Structure that holds one of several candidate delays, one per echo path.
+ */
+struct DelayCandidate {
+  /**
+   * Delay of the echo path in samples at the input sample rate.
+   */
+  size_t delay;
+
+  /**
+   * Number of the last 250 blocks (one second) in which a filter that
+   * explains at least a tenth of the capture energy found this delay. A delay
+   * needs a few votes before it is reported.
+   */
+  size_t votes;
+
+  /**
+   * Fraction of the capture energy that the filter that found this delay
+   * explained on the last block it found it, at most 1.
+   */
+  float accuracy;
+};
+
+/**
+ * Level of clock drift detected between the render and the capture signal.
+ */
+enum class ClockdriftLevel { kNone, kProbable, kVerified };
+
+/**
+ * History of the delay estimates produced while processing a signal.
+ *
+ * The history is stored as a structure of arrays: the i-th element of every
+ * vector describes the same estimate. Blocks that did not produce an estimate
+ * are not recorded.
+ */
+struct DelayTimeline {
+
+  /**
+   * Index of the block that produced the estimate.
+   */
+  std::vector<size_t> block_index;
+
+  /**
+   * Estimated delay in samples.
+   */
+  std::vector<size_t> delay;
+
+  /**
+   * Quality of the estimated delay.
+   */
+  std::vector<DelayEstimate::Quality> quality;
+
+  /**
+   * Number of blocks processed since the estimated delay last changed.
+   */
+  std::vector<size_t> blocks_since_last_change;
+
+  /**
+   * Level of clock drift detected at the time of the estimate.
+   */
+  std::vector<ClockdriftLevel> clockdrift;
+
+  /**
+   * Returns the number of recorded estimates.
+   */
+  size_t size() const { return block_index.size(); }
 };
 
 /**
@@ -65,10 +238,151 @@ class IncompatibleInputsError final : std::exception {
 
 };
 
+/**
+ * Exception that represents the sample rate of the input is not supported.
+ */
+class UnsupportedSampleRateError final : std::exception {
+ public:
+  const char* what() const noexcept override;
+};
+
+/**
+ * Stateful delay estimator that consumes render and capture signals in chunks
+ * of arbitrary size.
+ *
+ * Samples are buffered internally until a full block is available on both the
+ * render and the capture side, and every such pair of blocks is processed
+ * right away. Only the unpaired samples are kept, so memory usage does not
+ * depend on the length of the stream as long as both sides are pushed at a
+ * similar pace.
+ *
+ * A block holds 4 ms of audio. Inputs at 32 and 48 kHz are decimated to 16 kHz
+ * before estimating, but delays are still reported in samples at the input
+ * sample rate. The constructor throws UnsupportedSampleRateError for any other
+ * sample rate than 16, 32 or 48 kHz.
+ */
+class DelayEstimator {
+ public:
+  DelayEstimator(size_t sample_rate,
+                 size_t num_render_channels,
+                 size_t num_capture_channels,
+                 Setting setting);
+  ~DelayEstimator();
+
+  DelayEstimator(const DelayEstimator&) = delete;
+  DelayEstimator& operator=(const DelayEstimator&) = delete;
+
+  /**
+   * Appends interleaved samples to the render (far end) signal.
+   *
+   * num_samples counts the samples of all channels together, and does not
+   * need to be a multiple of the number of channels.
+   *
+   * Returns true if the delay estimate was updated during this call.
+   */
+  bool PushRender(const float* samples, size_t num_samples);
+
+  /**
+   * Appends interleaved samples to the capture (near end) signal.
+   *
+   * num_samples counts the samples of all channels together, and does not
+   * need to be a multiple of the number of channels.
+   *
+   * Returns true if the delay estimate was updated during this call.
+   */
+  bool PushCapture(const float* samples, size_t num_samples);
+
+  /**
+   * Returns whether a delay estimate is available.
+   */
+  bool HasEstimate() const;
+
+  /**
+   * Returns the most recent delay estimate.
+   *
+   * Throws NoEstimateAvailableError if no estimate is available yet.
+   */
+  DelayEstimate GetEstimate() const;
+
+  /**
+   * Returns at most Setting::num_delay_candidates delays found in the last
+   * second, by decreasing number of votes. Each delay stands for one echo
+   * path, so the first one usually matches GetEstimate. Returns an empty
+   * vector if the candidates are disabled.
+   */
+  std::vector<DelayCandidate> GetCandidates() const;
+
+  /**
+   * Returns the level of clock drift detected so far.
+   */
+  ClockdriftLevel GetClockdrift() const;
+
+  /**
+   * Discards every pushed sample and estimate, returning the estimator to the
+   * state it had right after construction. No memory is allocated.
+   */
+  void Reset();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/**
+ * Reusable state for EstimateDelay.
+ *
+ * Constructing an estimator allocates buffers whose sizes depend on the sample
+ * rate, the channel counts and the setting. A context keeps the estimator of
+ * the previous call, and reuses it after a reset when the next call has the
+ * same parameters. Estimating the delay of many short clips with the same
+ * format then does no allocation per call. The GCC-PHAT engine does not use
+ * the context.
+ *
+ * A context must not be used by several threads at once.
+ */
+class EstimatorContext {
+ public:
+  EstimatorContext();
+  ~EstimatorContext();
+
+  EstimatorContext(const EstimatorContext&) = delete;
+  EstimatorContext& operator=(const EstimatorContext&) = delete;
+
+  /**
+   * Returns an estimator for the given parameters in its initial state. The
+   * estimator is only valid until the next call.
+   */
+  DelayEstimator& Acquire(size_t sample_rate,
+                          size_t num_render_channels,
+                          size_t num_capture_channels,
+                          const Setting& setting);
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
 size_t EstimateDelay(WavFileInfo& render,
                      WavFileInfo& capture,
                      Setting setting);
 
+/**
+ * Estimates the delay like EstimateDelay, reusing the estimator kept in
+ * context instead of constructing a new one.
+ */
+size_t EstimateDelay(WavFileInfo& render,
+                     WavFileInfo& capture,
+                     Setting setting,
+                     EstimatorContext& context);
+
+/**
+ * Estimates the delay like EstimateDelay, but returns every estimate produced
+ * along the way instead of only the last one.
+ */
+DelayTimeline EstimateDelayTimeline(WavFileInfo& render,
+                                    WavFileInfo& capture,
+                                    Setting setting);
+
 }  // namespace webrtc_delay_estimation
 
 #endif
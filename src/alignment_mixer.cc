@@ -63,6 +63,13 @@ AlignmentMixer::AlignmentMixer(size_t num_channels,
   }
 }
 
+void AlignmentMixer::Reset() {
+  std::fill(strong_block_counters_.begin(), strong_block_counters_.end(), 0);
+  std::fill(cumulative_energies_.begin(), cumulative_energies_.end(), 0.f);
+  selected_channel_ = 0;
+  block_counter_ = 0;
+}
+
 void AlignmentMixer::ProduceOutput(rtc::ArrayView<const std::vector<float>> x,
                                    rtc::ArrayView<float, kBlockSize> y) {
   RTC_DCHECK_EQ(x.size(), num_channels_);
@@ -36,6 +36,9 @@ class AlignmentMixer {
   void ProduceOutput(rtc::ArrayView<const std::vector<float>> x,
                      rtc::ArrayView<float, kBlockSize> y);
 
+  // Forgets the channel activity observed so far.
+  void Reset();
+
   enum class MixingVariant { kDownmix, kAdaptive, kFixed };
 
  private:
@@ -9,11 +9,117 @@
  */
 #include "cascaded_biquad_filter.h"
 
+#if defined(WEBRTC_HAS_NEON)
+#include <arm_neon.h>
+#endif
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+#include <emmintrin.h>
+#endif
+
+#include <stdint.h>
+
 #include <algorithm>
 
 #include "checks.h"
 
 namespace webrtc {
+namespace {
+
+// Runs one sample through |biquad| and returns the output sample.
+float FilterSample(float x, CascadedBiQuadFilter::BiQuad* biquad) {
+  const auto* c_b = biquad->coefficients.b;
+  const auto* c_a = biquad->coefficients.a;
+  auto* m_x = biquad->x;
+  auto* m_y = biquad->y;
+  const float y = c_b[0] * x + c_b[1] * m_x[0] + c_b[2] * m_x[1] -
+                  c_a[0] * m_y[0] - c_a[1] * m_y[1];
+  m_x[1] = m_x[0];
+  m_x[0] = x;
+  m_y[1] = m_y[0];
+  m_y[0] = y;
+  return y;
+}
+
+// Stores every |down_sampling_factor|-th of the samples pushed in order,
+// starting with the first one.
+class DecimatedOutput {
+ public:
+  DecimatedOutput(size_t down_sampling_factor, rtc::ArrayView<float> y)
+      : down_sampling_factor_(down_sampling_factor), y_(y) {}
+
+  void Push(float sample) {
+    if (phase_ == 0) {
+      RTC_DCHECK_LT(index_, y_.size());
+      y_[index_++] = sample;
+    }
+    if (++phase_ == down_sampling_factor_) {
+      phase_ = 0;
+    }
+  }
+
+ private:
+  const size_t down_sampling_factor_;
+  const rtc::ArrayView<float> y_;
+  size_t phase_ = 0;
+  size_t index_ = 0;
+};
+
+#if defined(WEBRTC_ARCH_X86_FAMILY) || defined(WEBRTC_HAS_NEON)
+
+// Coefficients and states of four biquads, with biquad j in lane j.
+struct BiQuadLanes {
+  float b0[4];
+  float b1[4];
+  float b2[4];
+  float a0[4];
+  float a1[4];
+  float x0[4];
+  float x1[4];
+  float y0[4];
+  float y1[4];
+};
+
+void LoadLanes(const CascadedBiQuadFilter::BiQuad* biquads,
+               BiQuadLanes* lanes) {
+  for (size_t j = 0; j < 4; ++j) {
+    const CascadedBiQuadFilter::BiQuad& biquad = biquads[j];
+    lanes->b0[j] = biquad.coefficients.b[0];
+    lanes->b1[j] = biquad.coefficients.b[1];
+    lanes->b2[j] = biquad.coefficients.b[2];
+    lanes->a0[j] = biquad.coefficients.a[0];
+    lanes->a1[j] = biquad.coefficients.a[1];
+    lanes->x0[j] = biquad.x[0];
+    lanes->x1[j] = biquad.x[1];
+    lanes->y0[j] = biquad.y[0];
+    lanes->y1[j] = biquad.y[1];
+  }
+}
+
+void StoreLanes(const BiQuadLanes& lanes,
+                CascadedBiQuadFilter::BiQuad* biquads) {
+  for (size_t j = 0; j < 4; ++j) {
+    CascadedBiQuadFilter::BiQuad& biquad = biquads[j];
+    biquad.x[0] = lanes.x0[j];
+    biquad.x[1] = lanes.x1[j];
+    biquad.y[0] = lanes.y0[j];
+    biquad.y[1] = lanes.y1[j];
+  }
+}
+
+// Lanes whose biquad has a sample to process in the first three and in the
+// last three steps over a block, as biquad j lags j samples behind biquad 0.
+alignas(16) constexpr uint32_t kFirstStepMasks[3][4] = {
+    {0xffffffff, 0, 0, 0},
+    {0xffffffff, 0xffffffff, 0, 0},
+    {0xffffffff, 0xffffffff, 0xffffffff, 0}};
+alignas(16) constexpr uint32_t kLastStepMasks[3][4] = {
+    {0, 0xffffffff, 0xffffffff, 0xffffffff},
+    {0, 0, 0xffffffff, 0xffffffff},
+    {0, 0, 0, 0xffffffff}};
+
+#endif
+
+}  // namespace
 
 CascadedBiQuadFilter::BiQuadParam::BiQuadParam(std::complex<float> zero,
                                                std::complex<float> pole,
@@ -60,33 +166,42 @@ void CascadedBiQuadFilter::BiQuad::BiQuad::Reset() {
 CascadedBiQuadFilter::CascadedBiQuadFilter(
     const CascadedBiQuadFilter::BiQuadCoefficients& coefficients,
     size_t num_biquads)
-    : biquads_(num_biquads, BiQuad(coefficients)) {}
+    : apply_biquads_(&aec3::ApplyBiQuads),
+      biquads_(num_biquads, BiQuad(coefficients)) {}
 
 CascadedBiQuadFilter::CascadedBiQuadFilter(
-    const std::vector<CascadedBiQuadFilter::BiQuadParam>& biquad_params) {
+    const std::vector<CascadedBiQuadFilter::BiQuadParam>& biquad_params)
+    : apply_biquads_(&aec3::ApplyBiQuads) {
   for (const auto& param : biquad_params) {
     biquads_.push_back(BiQuad(param));
   }
 }
 
+CascadedBiQuadFilter::CascadedBiQuadFilter(
+    Aec3Optimization optimization,
+    rtc::ArrayView<const CascadedBiQuadFilter::BiQuadCoefficients>
+        coefficients)
+    : apply_biquads_(aec3::SelectApplyBiQuads(optimization)) {
+  for (const auto& biquad_coefficients : coefficients) {
+    biquads_.push_back(BiQuad(biquad_coefficients));
+  }
+}
+
 CascadedBiQuadFilter::~CascadedBiQuadFilter() = default;
 
 void CascadedBiQuadFilter::Process(rtc::ArrayView<const float> x,
                                    rtc::ArrayView<float> y) {
-  if (biquads_.size() > 0) {
-    ApplyBiQuad(x, y, &biquads_[0]);
-    for (size_t k = 1; k < biquads_.size(); ++k) {
-      ApplyBiQuad(y, y, &biquads_[k]);
-    }
-  } else {
-    std::copy(x.begin(), x.end(), y.begin());
-  }
+  apply_biquads_(biquads_, x, 1, y);
 }
 
 void CascadedBiQuadFilter::Process(rtc::ArrayView<float> y) {
-  for (auto& biquad : biquads_) {
-    ApplyBiQuad(y, y, &biquad);
-  }
+  apply_biquads_(biquads_, y, 1, y);
+}
+
+void CascadedBiQuadFilter::Decimate(rtc::ArrayView<const float> x,
+                                    size_t down_sampling_factor,
+                                    rtc::ArrayView<float> y) {
+  apply_biquads_(biquads_, x, down_sampling_factor, y);
 }
 
 void CascadedBiQuadFilter::Reset() {
@@ -95,23 +210,223 @@ void CascadedBiQuadFilter::Reset() {
   }
 }
 
-void CascadedBiQuadFilter::ApplyBiQuad(rtc::ArrayView<const float> x,
-                                       rtc::ArrayView<float> y,
-                                       CascadedBiQuadFilter::BiQuad* biquad) {
-  RTC_DCHECK_EQ(x.size(), y.size());
-  const auto* c_b = biquad->coefficients.b;
-  const auto* c_a = biquad->coefficients.a;
-  auto* m_x = biquad->x;
-  auto* m_y = biquad->y;
-  for (size_t k = 0; k < x.size(); ++k) {
-    const float tmp = x[k];
-    y[k] = c_b[0] * tmp + c_b[1] * m_x[0] + c_b[2] * m_x[1] - c_a[0] * m_y[0] -
-           c_a[1] * m_y[1];
-    m_x[1] = m_x[0];
-    m_x[0] = tmp;
-    m_y[1] = m_y[0];
-    m_y[0] = y[k];
+namespace aec3 {
+
+#if defined(WEBRTC_HAS_NEON)
+
+void ApplyBiQuads_NEON(rtc::ArrayView<CascadedBiQuadFilter::BiQuad> biquads,
+                       rtc::ArrayView<const float> x,
+                       size_t down_sampling_factor,
+                       rtc::ArrayView<float> y) {
+  RTC_DCHECK_EQ(x.size(), y.size() * down_sampling_factor);
+  const size_t num_samples = x.size();
+  if (biquads.size() < 4 || num_samples < 4) {
+    ApplyBiQuads(biquads, x, down_sampling_factor, y);
+    return;
+  }
+
+  BiQuadLanes lanes;
+  LoadLanes(biquads.data(), &lanes);
+  const float32x4_t b0 = vld1q_f32(lanes.b0);
+  const float32x4_t b1 = vld1q_f32(lanes.b1);
+  const float32x4_t b2 = vld1q_f32(lanes.b2);
+  const float32x4_t a0 = vld1q_f32(lanes.a0);
+  const float32x4_t a1 = vld1q_f32(lanes.a1);
+  float32x4_t x0 = vld1q_f32(lanes.x0);
+  float32x4_t x1 = vld1q_f32(lanes.x1);
+  float32x4_t y0 = vld1q_f32(lanes.y0);
+  float32x4_t y1 = vld1q_f32(lanes.y1);
+  float32x4_t out = vdupq_n_f32(0.f);
+
+  // Feeds |sample| to biquad 0 and the previous output of every biquad to the
+  // next one, only updating the states of the lanes in |mask|.
+  auto step = [&](float sample, uint32x4_t mask) {
+    const float32x4_t in = vextq_f32(vdupq_n_f32(sample), out, 3);
+    float32x4_t v = vmulq_f32(b0, in);
+    v = vaddq_f32(v, vmulq_f32(b1, x0));
+    v = vaddq_f32(v, vmulq_f32(b2, x1));
+    v = vsubq_f32(v, vmulq_f32(a0, y0));
+    v = vsubq_f32(v, vmulq_f32(a1, y1));
+    x1 = vbslq_f32(mask, x0, x1);
+    x0 = vbslq_f32(mask, in, x0);
+    y1 = vbslq_f32(mask, y0, y1);
+    y0 = vbslq_f32(mask, v, y0);
+    out = v;
+  };
+
+  // Runs the output of biquad 3 through the remaining biquads.
+  const rtc::ArrayView<CascadedBiQuadFilter::BiQuad> tail = biquads.subview(4);
+  DecimatedOutput output(down_sampling_factor, y);
+  auto emit = [&](float sample) {
+    for (auto& biquad : tail) {
+      sample = FilterSample(sample, &biquad);
+    }
+    output.Push(sample);
+  };
+
+  for (size_t k = 0; k < 3; ++k) {
+    step(x[k], vld1q_u32(kFirstStepMasks[k]));
+  }
+
+  for (size_t k = 3; k < num_samples; ++k) {
+    const float32x4_t in = vextq_f32(vdupq_n_f32(x[k]), out, 3);
+    float32x4_t v = vmulq_f32(b0, in);
+    v = vaddq_f32(v, vmulq_f32(b1, x0));
+    v = vaddq_f32(v, vmulq_f32(b2, x1));
+    v = vsubq_f32(v, vmulq_f32(a0, y0));
+    v = vsubq_f32(v, vmulq_f32(a1, y1));
+    x1 = x0;
+    x0 = in;
+    y1 = y0;
+    y0 = v;
+    out = v;
+    emit(vgetq_lane_f32(v, 3));
   }
+
+  for (size_t k = 0; k < 3; ++k) {
+    step(0.f, vld1q_u32(kLastStepMasks[k]));
+    emit(vgetq_lane_f32(out, 3));
+  }
+
+  vst1q_f32(lanes.x0, x0);
+  vst1q_f32(lanes.x1, x1);
+  vst1q_f32(lanes.y0, y0);
+  vst1q_f32(lanes.y1, y1);
+  StoreLanes(lanes, biquads.data());
 }
 
+#endif
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+
+void ApplyBiQuads_SSE2(rtc::ArrayView<CascadedBiQuadFilter::BiQuad> biquads,
+                       rtc::ArrayView<const float> x,
+                       size_t down_sampling_factor,
+                       rtc::ArrayView<float> y) {
+  RTC_DCHECK_EQ(x.size(), y.size() * down_sampling_factor);
+  const size_t num_samples = x.size();
+  if (biquads.size() < 4 || num_samples < 4) {
+    ApplyBiQuads(biquads, x, down_sampling_factor, y);
+    return;
+  }
+
+  BiQuadLanes lanes;
+  LoadLanes(biquads.data(), &lanes);
+  const __m128 b0 = _mm_loadu_ps(lanes.b0);
+  const __m128 b1 = _mm_loadu_ps(lanes.b1);
+  const __m128 b2 = _mm_loadu_ps(lanes.b2);
+  const __m128 a0 = _mm_loadu_ps(lanes.a0);
+  const __m128 a1 = _mm_loadu_ps(lanes.a1);
+  __m128 x0 = _mm_loadu_ps(lanes.x0);
+  __m128 x1 = _mm_loadu_ps(lanes.x1);
+  __m128 y0 = _mm_loadu_ps(lanes.y0);
+  __m128 y1 = _mm_loadu_ps(lanes.y1);
+  __m128 out = _mm_setzero_ps();
+
+  // Shifts the previous output of every biquad to the lane of the next one
+  // and |sample| into the lane of biquad 0.
+  auto shift_in = [&out](float sample) {
+    const __m128 shifted =
+        _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(out), 4));
+    return _mm_move_ss(shifted, _mm_set_ss(sample));
+  };
+  auto select = [](__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  };
+
+  // Runs one step of all the biquads, only updating the states of the lanes
+  // in |mask|.
+  auto step = [&](float sample, __m128 mask) {
+    const __m128 in = shift_in(sample);
+    __m128 v = _mm_mul_ps(b0, in);
+    v = _mm_add_ps(v, _mm_mul_ps(b1, x0));
+    v = _mm_add_ps(v, _mm_mul_ps(b2, x1));
+    v = _mm_sub_ps(v, _mm_mul_ps(a0, y0));
+    v = _mm_sub_ps(v, _mm_mul_ps(a1, y1));
+    x1 = select(mask, x0, x1);
+    x0 = select(mask, in, x0);
+    y1 = select(mask, y0, y1);
+    y0 = select(mask, v, y0);
+    out = v;
+  };
+
+  // Runs the output of biquad 3 through the remaining biquads.
+  const rtc::ArrayView<CascadedBiQuadFilter::BiQuad> tail = biquads.subview(4);
+  DecimatedOutput output(down_sampling_factor, y);
+  auto emit = [&](__m128 v) {
+    float sample = _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+    for (auto& biquad : tail) {
+      sample = FilterSample(sample, &biquad);
+    }
+    output.Push(sample);
+  };
+
+  for (size_t k = 0; k < 3; ++k) {
+    step(x[k],
+         _mm_load_ps(reinterpret_cast<const float*>(kFirstStepMasks[k])));
+  }
+
+  for (size_t k = 3; k < num_samples; ++k) {
+    const __m128 in = shift_in(x[k]);
+    __m128 v = _mm_mul_ps(b0, in);
+    v = _mm_add_ps(v, _mm_mul_ps(b1, x0));
+    v = _mm_add_ps(v, _mm_mul_ps(b2, x1));
+    v = _mm_sub_ps(v, _mm_mul_ps(a0, y0));
+    v = _mm_sub_ps(v, _mm_mul_ps(a1, y1));
+    x1 = x0;
+    x0 = in;
+    y1 = y0;
+    y0 = v;
+    out = v;
+    emit(v);
+  }
+
+  for (size_t k = 0; k < 3; ++k) {
+    step(0.f, _mm_load_ps(reinterpret_cast<const float*>(kLastStepMasks[k])));
+    emit(out);
+  }
+
+  _mm_storeu_ps(lanes.x0, x0);
+  _mm_storeu_ps(lanes.x1, x1);
+  _mm_storeu_ps(lanes.y0, y0);
+  _mm_storeu_ps(lanes.y1, y1);
+  StoreLanes(lanes, biquads.data());
+}
+
+#endif
+
+void ApplyBiQuads(rtc::ArrayView<CascadedBiQuadFilter::BiQuad> biquads,
+                  rtc::ArrayView<const float> x,
+                  size_t down_sampling_factor,
+                  rtc::ArrayView<float> y) {
+  RTC_DCHECK_EQ(x.size(), y.size() * down_sampling_factor);
+  DecimatedOutput output(down_sampling_factor, y);
+  for (float sample : x) {
+    for (auto& biquad : biquads) {
+      sample = FilterSample(sample, &biquad);
+    }
+    output.Push(sample);
+  }
+}
+
+CascadedBiQuadFilter::ApplyBiQuadsFunction SelectApplyBiQuads(
+    Aec3Optimization optimization) {
+  switch (optimization) {
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+    case Aec3Optimization::kSse2:
+    case Aec3Optimization::kAvx2:
+    case Aec3Optimization::kAvx512:
+      return &ApplyBiQuads_SSE2;
+#endif
+#if defined(WEBRTC_HAS_NEON)
+    case Aec3Optimization::kNeon:
+      return &ApplyBiQuads_NEON;
+#endif
+    default:
+      return &ApplyBiQuads;
+  }
+}
+
+}  // namespace aec3
+
 }  // namespace webrtc
@@ -16,6 +16,8 @@
 #include <complex>
 #include <vector>
 
+#include "aec3_common.h"
+#include "arch.h"
 #include "array_view.h"
 
 namespace webrtc {
@@ -51,11 +53,23 @@ class CascadedBiQuadFilter {
     float y[2];
   };
 
+  // Pointer to a function applying a cascade of biquads and decimating the
+  // output.
+  using ApplyBiQuadsFunction =
+      void (*)(rtc::ArrayView<CascadedBiQuadFilter::BiQuad> biquads,
+               rtc::ArrayView<const float> x,
+               size_t down_sampling_factor,
+               rtc::ArrayView<float> y);
+
   CascadedBiQuadFilter(
       const CascadedBiQuadFilter::BiQuadCoefficients& coefficients,
       size_t num_biquads);
   explicit CascadedBiQuadFilter(
       const std::vector<CascadedBiQuadFilter::BiQuadParam>& biquad_params);
+  CascadedBiQuadFilter(
+      Aec3Optimization optimization,
+      rtc::ArrayView<const CascadedBiQuadFilter::BiQuadCoefficients>
+          coefficients);
   ~CascadedBiQuadFilter();
   CascadedBiQuadFilter(const CascadedBiQuadFilter&) = delete;
   CascadedBiQuadFilter& operator=(const CascadedBiQuadFilter&) = delete;
@@ -64,17 +78,61 @@ class CascadedBiQuadFilter {
   void Process(rtc::ArrayView<const float> x, rtc::ArrayView<float> y);
   // Applies the biquads on the values in y in an in-place manner.
   void Process(rtc::ArrayView<float> y);
+  // Applies the biquads on the values in x and only keeps every
+  // |down_sampling_factor|-th output sample in y, starting with the first.
+  void Decimate(rtc::ArrayView<const float> x,
+                size_t down_sampling_factor,
+                rtc::ArrayView<float> y);
   // Resets the filter to its initial state.
   void Reset();
 
  private:
-  void ApplyBiQuad(rtc::ArrayView<const float> x,
-                   rtc::ArrayView<float> y,
-                   CascadedBiQuadFilter::BiQuad* biquad);
-
+  const ApplyBiQuadsFunction apply_biquads_;
   std::vector<BiQuad> biquads_;
 };
 
+namespace aec3 {
+
+#if defined(WEBRTC_HAS_NEON)
+
+// Applies the biquads in a cascaded manner, optimized for NEON.
+void ApplyBiQuads_NEON(rtc::ArrayView<CascadedBiQuadFilter::BiQuad> biquads,
+                       rtc::ArrayView<const float> x,
+                       size_t down_sampling_factor,
+                       rtc::ArrayView<float> y);
+
+#endif
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+
+// Applies the biquads in a cascaded manner, optimized for SSE2.
+void ApplyBiQuads_SSE2(rtc::ArrayView<CascadedBiQuadFilter::BiQuad> biquads,
+                       rtc::ArrayView<const float> x,
+                       size_t down_sampling_factor,
+                       rtc::ArrayView<float> y);
+
+#endif
+
+// Applies the biquads on the values in x in a cascaded manner, running every
+// sample through all of them before the next one, and stores every
+// |down_sampling_factor|-th output sample in y. x and y may be the same array
+// when |down_sampling_factor| is one. The optimized versions run the first
+// four biquads at once, one in each lane, with biquad j + 1 processing the
+// sample that biquad j processed in the step before, and the others on each
+// sample coming out of biquad 3. They perform the same operations in the same
+// order for every sample, so that their output is identical to this function
+// unless the compiler fuses the multiplications and additions of one of them.
+void ApplyBiQuads(rtc::ArrayView<CascadedBiQuadFilter::BiQuad> biquads,
+                  rtc::ArrayView<const float> x,
+                  size_t down_sampling_factor,
+                  rtc::ArrayView<float> y);
+
+// Returns the function applying a cascade of biquads for |optimization|.
+CascadedBiQuadFilter::ApplyBiQuadsFunction SelectApplyBiQuads(
+    Aec3Optimization optimization);
+
+}  // namespace aec3
+
 }  // namespace webrtc
 
 #endif  // MODULES_AUDIO_PROCESSING_UTILITY_CASCADED_BIQUAD_FILTER_H_
@@ -28,6 +28,7 @@ class ClockdriftDetector {
   ClockdriftDetector();
   ~ClockdriftDetector();
   void Update(int delay_estimate);
+  void Reset();
   Level ClockdriftLevel() const { return level_; }
 
  private:
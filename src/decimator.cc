@@ -9,83 +9,132 @@
  */
 #include "decimator.h"
 
-#include <array>
-#include <vector>
-
 #include "aec3_common.h"
 #include "checks.h"
 
 namespace webrtc {
 namespace {
 
-// signal.butter(2, 3400/8000.0, 'lowpass', analog=False)
-const std::vector<CascadedBiQuadFilter::BiQuadParam> GetLowPassFilterDS2() {
-  return std::vector<CascadedBiQuadFilter::BiQuadParam>{
-      {{-1.f, 0.f}, {0.13833231f, 0.40743176f}, 0.22711796393486466f},
-      {{-1.f, 0.f}, {0.13833231f, 0.40743176f}, 0.22711796393486466f},
-      {{-1.f, 0.f}, {0.13833231f, 0.40743176f}, 0.22711796393486466f}};
+// Returns the coefficients that CascadedBiQuadFilter::BiQuad computes for the
+// zeros at (z_r + z_i*i) and (z_r - z_i*i), or at z_r and -z_r if
+// |mirror_zero_along_i_axis| is set, and the poles at (p_r + p_i*i) and
+// (p_r - p_i*i).
+constexpr CascadedBiQuadFilter::BiQuadCoefficients ZeroPoleToBiQuad(
+    float z_r,
+    float z_i,
+    float p_r,
+    float p_i,
+    float gain,
+    bool mirror_zero_along_i_axis = false) {
+  if (mirror_zero_along_i_axis) {
+    return {{gain * 1.f, 0.f, gain * -(z_r * z_r)},
+            {-2.f * p_r, p_r * p_r + p_i * p_i}};
+  }
+  return {{gain * 1.f, gain * -2.f * z_r, gain * (z_r * z_r + z_i * z_i)},
+          {-2.f * p_r, p_r * p_r + p_i * p_i}};
 }
 
-// signal.ellip(6, 1, 40, 1800/8000, btype='lowpass', analog=False)
-const std::vector<CascadedBiQuadFilter::BiQuadParam> GetLowPassFilterDS4() {
-  return std::vector<CascadedBiQuadFilter::BiQuadParam>{
-      {{-0.08873842f, 0.99605496f}, {0.75916227f, 0.23841065f}, 0.26250696827f},
-      {{0.62273832f, 0.78243018f}, {0.74892112f, 0.5410152f}, 0.26250696827f},
-      {{0.71107693f, 0.70311421f}, {0.74895534f, 0.63924616f}, 0.26250696827f}};
-}
+// signal.butter(2, 3400/8000.0, 'lowpass', analog=False), followed by
+// signal.butter(2, 1000/8000.0, 'highpass', analog=False) to reduce the
+// impact of near-end noise.
+constexpr CascadedBiQuadFilter::BiQuadCoefficients kFilterDS2[] = {
+    ZeroPoleToBiQuad(-1.f, 0.f, 0.13833231f, 0.40743176f, 0.22711796393486466f),
+    ZeroPoleToBiQuad(-1.f, 0.f, 0.13833231f, 0.40743176f, 0.22711796393486466f),
+    ZeroPoleToBiQuad(-1.f, 0.f, 0.13833231f, 0.40743176f, 0.22711796393486466f),
+    ZeroPoleToBiQuad(1.f, 0.f, 0.72712179f, 0.21296904f, 0.7570763753338849f)};
 
-// signal.cheby1(1, 6, [1000/8000, 2000/8000], btype='bandpass', analog=False)
-const std::vector<CascadedBiQuadFilter::BiQuadParam> GetBandPassFilterDS8() {
-  return std::vector<CascadedBiQuadFilter::BiQuadParam>{
-      {{1.f, 0.f}, {0.7601815f, 0.46423542f}, 0.10330478266505948f, true},
-      {{1.f, 0.f}, {0.7601815f, 0.46423542f}, 0.10330478266505948f, true},
-      {{1.f, 0.f}, {0.7601815f, 0.46423542f}, 0.10330478266505948f, true},
-      {{1.f, 0.f}, {0.7601815f, 0.46423542f}, 0.10330478266505948f, true},
-      {{1.f, 0.f}, {0.7601815f, 0.46423542f}, 0.10330478266505948f, true}};
-}
+// signal.ellip(6, 1, 40, 1800/8000, btype='lowpass', analog=False), followed
+// by the same high-pass filter as above.
+constexpr CascadedBiQuadFilter::BiQuadCoefficients kFilterDS4[] = {
+    ZeroPoleToBiQuad(-0.08873842f, 0.99605496f, 0.75916227f, 0.23841065f,
+                     0.26250696827f),
+    ZeroPoleToBiQuad(0.62273832f, 0.78243018f, 0.74892112f, 0.5410152f,
+                     0.26250696827f),
+    ZeroPoleToBiQuad(0.71107693f, 0.70311421f, 0.74895534f, 0.63924616f,
+                     0.26250696827f),
+    ZeroPoleToBiQuad(1.f, 0.f, 0.72712179f, 0.21296904f, 0.7570763753338849f)};
 
-// signal.butter(2, 1000/8000.0, 'highpass', analog=False)
-const std::vector<CascadedBiQuadFilter::BiQuadParam> GetHighPassFilter() {
-  return std::vector<CascadedBiQuadFilter::BiQuadParam>{
-      {{1.f, 0.f}, {0.72712179f, 0.21296904f}, 0.7570763753338849f}};
+// signal.cheby1(1, 6, [1000/8000, 2000/8000], btype='bandpass', analog=False),
+// which needs no high-pass filter.
+constexpr CascadedBiQuadFilter::BiQuadCoefficients kFilterDS8[] = {
+    ZeroPoleToBiQuad(1.f, 0.f, 0.7601815f, 0.46423542f, 0.10330478266505948f,
+                     true),
+    ZeroPoleToBiQuad(1.f, 0.f, 0.7601815f, 0.46423542f, 0.10330478266505948f,
+                     true),
+    ZeroPoleToBiQuad(1.f, 0.f, 0.7601815f, 0.46423542f, 0.10330478266505948f,
+                     true),
+    ZeroPoleToBiQuad(1.f, 0.f, 0.7601815f, 0.46423542f, 0.10330478266505948f,
+                     true),
+    ZeroPoleToBiQuad(1.f, 0.f, 0.7601815f, 0.46423542f, 0.10330478266505948f,
+                     true)};
+
+rtc::ArrayView<const CascadedBiQuadFilter::BiQuadCoefficients> GetFilter(
+    size_t down_sampling_factor) {
+  switch (down_sampling_factor) {
+    case 4:
+      return kFilterDS4;
+    case 8:
+      return kFilterDS8;
+    default:
+      return kFilterDS2;
+  }
 }
 
-const std::vector<CascadedBiQuadFilter::BiQuadParam> GetPassThroughFilter() {
-  return std::vector<CascadedBiQuadFilter::BiQuadParam>{};
+// Number of taps of the FIR filters, enough for transitions of about 700 Hz.
+constexpr size_t kNumFirTaps = 128;
+
+// Returns FIR filter coefficients with the same pass band as the biquads.
+std::vector<float> GetFirCoefficients(size_t down_sampling_factor) {
+  constexpr double kSampleRateHz = 16000.0;
+  constexpr double kLowCutoffHz = 1000.0;
+  const double high_cutoff_hz = down_sampling_factor == 4
+                                    ? 1800.0
+                                    : (down_sampling_factor == 8 ? 2000.0
+                                                                 : 3400.0);
+  return FirDecimator::BandPassCoefficients(kLowCutoffHz / kSampleRateHz,
+                                            high_cutoff_hz / kSampleRateHz,
+                                            kNumFirTaps);
 }
+
 }  // namespace
 
-Decimator::Decimator(size_t down_sampling_factor)
-    : down_sampling_factor_(down_sampling_factor),
-      anti_aliasing_filter_(down_sampling_factor_ == 4
-                                ? GetLowPassFilterDS4()
-                                : (down_sampling_factor_ == 8
-                                       ? GetBandPassFilterDS8()
-                                       : GetLowPassFilterDS2())),
-      noise_reduction_filter_(down_sampling_factor_ == 8
-                                  ? GetPassThroughFilter()
-                                  : GetHighPassFilter()) {
+Decimator::Decimator(Aec3Optimization optimization,
+                     size_t down_sampling_factor,
+                     bool use_fir_filter)
+    : down_sampling_factor_(down_sampling_factor) {
   RTC_DCHECK(down_sampling_factor_ == 2 || down_sampling_factor_ == 4 ||
              down_sampling_factor_ == 8);
+  if (use_fir_filter) {
+    fir_decimator_.reset(
+        new FirDecimator(optimization, down_sampling_factor_,
+                         GetFirCoefficients(down_sampling_factor_)));
+  } else {
+    filter_.reset(new CascadedBiQuadFilter(optimization,
+                                           GetFilter(down_sampling_factor_)));
+  }
+}
+
+void Decimator::Reset() {
+  if (fir_decimator_) {
+    fir_decimator_->Reset();
+  } else {
+    filter_->Reset();
+  }
 }
 
 void Decimator::Decimate(rtc::ArrayView<const float> in,
                          rtc::ArrayView<float> out) {
   RTC_DCHECK_EQ(kBlockSize, in.size());
   RTC_DCHECK_EQ(kBlockSize / down_sampling_factor_, out.size());
-  std::array<float, kBlockSize> x;
 
-  // Limit the frequency content of the signal to avoid aliasing.
-  anti_aliasing_filter_.Process(in, x);
-
-  // Reduce the impact of near-end noise.
-  noise_reduction_filter_.Process(x);
-
-  // Downsample the signal.
-  for (size_t j = 0, k = 0; j < out.size(); ++j, k += down_sampling_factor_) {
-    RTC_DCHECK_GT(kBlockSize, k);
-    out[j] = x[k];
+  if (fir_decimator_) {
+    fir_decimator_->Decimate(in, out);
+    return;
   }
+
+  // Limit the frequency content of the signal to avoid aliasing, reduce the
+  // impact of near-end noise and downsample the signal, in a single pass.
+  filter_->Decimate(in, down_sampling_factor_, out);
 }
 
 }  // namespace webrtc
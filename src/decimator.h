@@ -12,27 +12,40 @@
 #define MODULES_AUDIO_PROCESSING_AEC3_DECIMATOR_H_
 
 #include <array>
+#include <memory>
 #include <vector>
 
 #include "aec3_common.h"
 #include "array_view.h"
 #include "cascaded_biquad_filter.h"
 #include "constructor_magic.h"
+#include "fir_decimator.h"
 
 namespace webrtc {
 
 // Provides functionality for decimating a signal.
 class Decimator {
  public:
-  explicit Decimator(size_t down_sampling_factor);
+  // The signal is filtered by cascades of biquads, or by linear-phase FIR
+  // filters with the same pass bands if |use_fir_filter| is set. The FIR
+  // filters only compute the samples that are kept.
+  Decimator(Aec3Optimization optimization,
+            size_t down_sampling_factor,
+            bool use_fir_filter);
 
   // Downsamples the signal.
   void Decimate(rtc::ArrayView<const float> in, rtc::ArrayView<float> out);
 
+  // Resets the filter states.
+  void Reset();
+
  private:
   const size_t down_sampling_factor_;
-  CascadedBiQuadFilter anti_aliasing_filter_;
-  CascadedBiQuadFilter noise_reduction_filter_;
+  // Anti-aliasing filter followed by the noise reduction filter, in a single
+  // cascade so that every sample runs through all of them at once. Exactly one
+  // of filter_ and fir_decimator_ is set.
+  std::unique_ptr<CascadedBiQuadFilter> filter_;
+  std::unique_ptr<FirDecimator> fir_decimator_;
 
   RTC_DISALLOW_COPY_AND_ASSIGN(Decimator);
 };
@@ -0,0 +1,87 @@
+#include "deinterleave.h"
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+#include <emmintrin.h>
+#endif
+
+#include "checks.h"
+
+namespace webrtc {
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+
+void DeinterleaveBlock_SSE2(const float* interleaved,
+                            std::vector<std::vector<float>>* block) {
+  const size_t num_channels = block->size();
+  const size_t num_frames = (*block)[0].size();
+  RTC_DCHECK_EQ(0, num_frames % 4);
+
+  if (num_channels == 2) {
+    float* left = (*block)[0].data();
+    float* right = (*block)[1].data();
+
+    // Split four frames at a time into the even and the odd samples.
+    for (size_t k = 0; k < num_frames; k += 4, interleaved += 8) {
+      const __m128 a = _mm_loadu_ps(interleaved);
+      const __m128 b = _mm_loadu_ps(interleaved + 4);
+      _mm_storeu_ps(left + k, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(right + k, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    return;
+  }
+
+  if (num_channels % 4 == 0) {
+    // Transpose 4x4 tiles of four frames by four channels.
+    for (size_t k = 0; k < num_frames; k += 4) {
+      const float* frames = interleaved + k * num_channels;
+      for (size_t ch = 0; ch < num_channels; ch += 4) {
+        __m128 r0 = _mm_loadu_ps(frames + ch);
+        __m128 r1 = _mm_loadu_ps(frames + num_channels + ch);
+        __m128 r2 = _mm_loadu_ps(frames + 2 * num_channels + ch);
+        __m128 r3 = _mm_loadu_ps(frames + 3 * num_channels + ch);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(&(*block)[ch][k], r0);
+        _mm_storeu_ps(&(*block)[ch + 1][k], r1);
+        _mm_storeu_ps(&(*block)[ch + 2][k], r2);
+        _mm_storeu_ps(&(*block)[ch + 3][k], r3);
+      }
+    }
+    return;
+  }
+
+  DeinterleaveBlock(interleaved, block);
+}
+
+#endif
+
+void DeinterleaveBlock(const float* interleaved,
+                       std::vector<std::vector<float>>* block) {
+  RTC_DCHECK(block);
+  RTC_DCHECK_LT(0, block->size());
+  const size_t num_channels = block->size();
+  const size_t num_frames = (*block)[0].size();
+  for (size_t ch = 0; ch < num_channels; ++ch) {
+    RTC_DCHECK_EQ(num_frames, (*block)[ch].size());
+    float* out = (*block)[ch].data();
+    for (size_t k = 0, j = ch; k < num_frames; ++k, j += num_channels) {
+      out[k] = interleaved[j];
+    }
+  }
+}
+
+DeinterleaveBlockFunction SelectDeinterleaveBlock(
+    Aec3Optimization optimization) {
+  switch (optimization) {
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+    case Aec3Optimization::kSse2:
+      return &DeinterleaveBlock_SSE2;
+    case Aec3Optimization::kAvx2:
+    case Aec3Optimization::kAvx512:
+      return &DeinterleaveBlock_AVX2;
+#endif
+    default:
+      return &DeinterleaveBlock;
+  }
+}
+
+}  // namespace webrtc
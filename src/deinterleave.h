@@ -0,0 +1,42 @@
+#ifndef DEINTERLEAVE_H_
+#define DEINTERLEAVE_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "aec3_common.h"
+#include "arch.h"
+
+namespace webrtc {
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+
+// Deinterleaves a block that is optimized for SSE2.
+void DeinterleaveBlock_SSE2(const float* interleaved,
+                            std::vector<std::vector<float>>* block);
+
+// Deinterleaves a block that is optimized for AVX2.
+void DeinterleaveBlock_AVX2(const float* interleaved,
+                            std::vector<std::vector<float>>* block);
+
+#endif
+
+// Splits interleaved frames into the per-channel vectors of |block|. The number
+// of channels is given by the number of vectors in |block| and the number of
+// frames by their size, which must be the same for every channel and a
+// multiple of 8.
+void DeinterleaveBlock(const float* interleaved,
+                       std::vector<std::vector<float>>* block);
+
+// Pointer to a deinterleaving function.
+using DeinterleaveBlockFunction =
+    void (*)(const float* interleaved, std::vector<std::vector<float>>* block);
+
+// Returns the deinterleaving function for |optimization|.
+DeinterleaveBlockFunction SelectDeinterleaveBlock(
+    Aec3Optimization optimization);
+
+}  // namespace webrtc
+
+#endif  // DEINTERLEAVE_H_
@@ -0,0 +1,79 @@
+#include "deinterleave.h"
+
+#include <immintrin.h>
+
+#include "checks.h"
+
+namespace webrtc {
+
+void DeinterleaveBlock_AVX2(const float* interleaved,
+                            std::vector<std::vector<float>>* block) {
+  const size_t num_channels = block->size();
+  const size_t num_frames = (*block)[0].size();
+  RTC_DCHECK_EQ(0, num_frames % 8);
+
+  if (num_channels == 2) {
+    float* left = (*block)[0].data();
+    float* right = (*block)[1].data();
+
+    // Split eight frames at a time into the even and the odd samples. The
+    // in-lane shuffle leaves the halves in the order 0, 2, 1, 3, which the
+    // cross-lane permute puts back in order.
+    for (size_t k = 0; k < num_frames; k += 8, interleaved += 16) {
+      const __m256 a = _mm256_loadu_ps(interleaved);
+      const __m256 b = _mm256_loadu_ps(interleaved + 8);
+      const __m256 even = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+      const __m256 odd = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+      _mm256_storeu_ps(left + k, _mm256_castpd_ps(_mm256_permute4x64_pd(
+                                     _mm256_castps_pd(even),
+                                     _MM_SHUFFLE(3, 1, 2, 0))));
+      _mm256_storeu_ps(right + k, _mm256_castpd_ps(_mm256_permute4x64_pd(
+                                      _mm256_castps_pd(odd),
+                                      _MM_SHUFFLE(3, 1, 2, 0))));
+    }
+    return;
+  }
+
+  if (num_channels % 4 == 0) {
+    // Transpose 4x4 tiles of four frames by four channels, with frames k to
+    // k + 3 in the lower lane and frames k + 4 to k + 7 in the upper lane.
+    const size_t stride = num_channels;
+    for (size_t k = 0; k < num_frames; k += 8) {
+      const float* lo = interleaved + k * stride;
+      const float* hi = lo + 4 * stride;
+      for (size_t ch = 0; ch < num_channels; ch += 4) {
+        __m256 r0 = _mm256_insertf128_ps(
+            _mm256_castps128_ps256(_mm_loadu_ps(lo + ch)),
+            _mm_loadu_ps(hi + ch), 1);
+        __m256 r1 = _mm256_insertf128_ps(
+            _mm256_castps128_ps256(_mm_loadu_ps(lo + stride + ch)),
+            _mm_loadu_ps(hi + stride + ch), 1);
+        __m256 r2 = _mm256_insertf128_ps(
+            _mm256_castps128_ps256(_mm_loadu_ps(lo + 2 * stride + ch)),
+            _mm_loadu_ps(hi + 2 * stride + ch), 1);
+        __m256 r3 = _mm256_insertf128_ps(
+            _mm256_castps128_ps256(_mm_loadu_ps(lo + 3 * stride + ch)),
+            _mm_loadu_ps(hi + 3 * stride + ch), 1);
+
+        const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+        const __m256 t1 = _mm256_unpacklo_ps(r2, r3);
+        const __m256 t2 = _mm256_unpackhi_ps(r0, r1);
+        const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+        r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+        r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+        r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+        _mm256_storeu_ps(&(*block)[ch][k], r0);
+        _mm256_storeu_ps(&(*block)[ch + 1][k], r1);
+        _mm256_storeu_ps(&(*block)[ch + 2][k], r2);
+        _mm256_storeu_ps(&(*block)[ch + 3][k], r3);
+      }
+    }
+    return;
+  }
+
+  DeinterleaveBlock(interleaved, block);
+}
+
+}  // namespace webrtc
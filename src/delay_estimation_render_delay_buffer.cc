@@ -0,0 +1,83 @@
+/*
+ *  Copyright (c) 2018 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "delay_estimation_render_delay_buffer.h"
+
+#include <array>
+
+#include "aec3_common.h"
+#include "checks.h"
+#include "dispatch_table.h"
+
+namespace webrtc {
+
+DelayEstimationRenderDelayBuffer::DelayEstimationRenderDelayBuffer(
+    const EchoCanceller3Config& config,
+    int sample_rate_hz,
+    size_t num_render_channels)
+    : RenderDelayBufferBase(config, config.delay.fine_down_sampling_factor),
+      render_mixer_(num_render_channels, config.delay.render_alignment_mixing),
+      render_decimator_(GetDispatchTable().optimization,
+                        down_sampling_factor(),
+                        config.delay.use_fir_decimator),
+      render_ds_(sub_block_size(), 0.f),
+      fine_render_ds_(fine_sub_block_size(), 0.f) {
+  RTC_DCHECK(ValidFullBandRate(sample_rate_hz));
+  if (config.delay.fine_down_sampling_factor > 0) {
+    fine_render_decimator_.reset(new Decimator(
+        GetDispatchTable().optimization, config.delay.fine_down_sampling_factor,
+        config.delay.use_fir_decimator));
+  }
+  Reset();
+}
+
+DelayEstimationRenderDelayBuffer::~DelayEstimationRenderDelayBuffer() =
+    default;
+
+// Clears the render signal, the buffer indices and the buffering statistics.
+void DelayEstimationRenderDelayBuffer::Clear() {
+  render_mixer_.Reset();
+  render_decimator_.Reset();
+  if (fine_render_decimator_) {
+    fine_render_decimator_->Reset();
+  }
+  ClearBuffering();
+}
+
+// Decimates a block into the low rate render buffers.
+void DelayEstimationRenderDelayBuffer::InsertBlock(
+    const std::vector<std::vector<std::vector<float>>>& block) {
+  auto& ds = render_ds_;
+  RTC_DCHECK_LT(0, block.size());
+
+  std::array<float, kBlockSize> downmixed_render;
+  render_mixer_.ProduceOutput(block[0], downmixed_render);
+
+  // The gain is linear, so it may as well be applied after the mixing.
+  const float gain = render_linear_amplitude_gain();
+  if (gain != 1.f) {
+    for (auto& x : downmixed_render) {
+      x *= gain;
+    }
+  }
+
+  render_decimator_.Decimate(downmixed_render, ds);
+  data_dumper()->DumpWav("aec3_render_decimator_output", ds.size(), ds.data(),
+                         16000 / down_sampling_factor(), 1);
+  low_rate()->WriteReversed(ds);
+
+  if (fine_render_decimator_) {
+    auto& fine_ds = fine_render_ds_;
+    fine_render_decimator_->Decimate(downmixed_render, fine_ds);
+    fine_low_rate()->WriteReversed(fine_ds);
+  }
+}
+
+}  // namespace webrtc
@@ -0,0 +1,61 @@
+/*
+ *  Copyright (c) 2018 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef MODULES_AUDIO_PROCESSING_AEC3_DELAY_ESTIMATION_RENDER_DELAY_BUFFER_H_
+#define MODULES_AUDIO_PROCESSING_AEC3_DELAY_ESTIMATION_RENDER_DELAY_BUFFER_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <vector>
+
+#include "alignment_mixer.h"
+#include "decimator.h"
+#include "echo_canceller3_config.h"
+#include "render_delay_buffer_base.h"
+
+namespace webrtc {
+
+// Render delay buffer that only maintains the decimated render signal used by
+// the delay estimator. The buffering logic matches that of the full render
+// delay buffer, but no full band blocks, FFTs or spectra are stored. If a fine
+// delay search stage is configured, the render signal is also decimated into
+// the second low rate buffer.
+class DelayEstimationRenderDelayBuffer final : public RenderDelayBufferBase {
+ public:
+  DelayEstimationRenderDelayBuffer(const EchoCanceller3Config& config,
+                                   int sample_rate_hz,
+                                   size_t num_render_channels);
+  DelayEstimationRenderDelayBuffer() = delete;
+  ~DelayEstimationRenderDelayBuffer() override;
+
+  // Clears the buffered render signal and returns the buffer to the state it
+  // had when it was created.
+  void Clear();
+
+  // No render buffer for the echo remover is maintained.
+  RenderBuffer* GetRenderBuffer() override { return nullptr; }
+
+ private:
+  AlignmentMixer render_mixer_;
+  Decimator render_decimator_;
+  std::vector<float> render_ds_;
+  std::unique_ptr<Decimator> fine_render_decimator_;
+  std::vector<float> fine_render_ds_;
+
+  void InsertBlock(
+      const std::vector<std::vector<std::vector<float>>>& block) override;
+  // No full band buffers are kept, so only the indices move.
+  void ApplyBlockIndices(int read, int write) override {}
+};
+
+}  // namespace webrtc
+
+#endif  // MODULES_AUDIO_PROCESSING_AEC3_DELAY_ESTIMATION_RENDER_DELAY_BUFFER_H_
@@ -0,0 +1,40 @@
+#include "dispatch_table.h"
+
+#include "arraysize.h"
+#include "checks.h"
+
+namespace webrtc {
+
+namespace {
+
+DispatchTable CreateDispatchTable(Aec3Optimization optimization) {
+  DispatchTable table;
+  table.optimization = optimization;
+  table.spectrum = FftData::SelectSpectrum(optimization);
+  table.deinterleave_block = SelectDeinterleaveBlock(optimization);
+  return table;
+}
+
+}  // namespace
+
+const DispatchTable& GetDispatchTable(Aec3Optimization optimization) {
+  // Indexed by the values of Aec3Optimization.
+  static const DispatchTable kTables[] = {
+      CreateDispatchTable(Aec3Optimization::kNone),
+      CreateDispatchTable(Aec3Optimization::kSse2),
+      CreateDispatchTable(Aec3Optimization::kAvx2),
+      CreateDispatchTable(Aec3Optimization::kAvx512),
+      CreateDispatchTable(Aec3Optimization::kNeon)};
+
+  const size_t index = static_cast<size_t>(optimization);
+  RTC_DCHECK_LT(index, arraysize(kTables));
+  RTC_DCHECK(kTables[index].optimization == optimization);
+  return kTables[index];
+}
+
+const DispatchTable& GetDispatchTable() {
+  static const DispatchTable& table = GetDispatchTable(DetectOptimization());
+  return table;
+}
+
+}  // namespace webrtc
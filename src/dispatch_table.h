@@ -0,0 +1,29 @@
+#ifndef DISPATCH_TABLE_H_
+#define DISPATCH_TABLE_H_
+
+#include "aec3_common.h"
+#include "deinterleave.h"
+#include "fft_data.h"
+
+namespace webrtc {
+
+// The kernels for one instruction set that are called without an object to
+// resolve them. Objects like FirDecimator and MatchedFilter resolve their
+// kernels once when they are constructed from |optimization|, as some of them
+// are also specialized for the sizes of the object.
+struct DispatchTable {
+  Aec3Optimization optimization;
+  FftData::SpectrumFunction spectrum;
+  DeinterleaveBlockFunction deinterleave_block;
+};
+
+// Returns the dispatch table for |optimization|.
+const DispatchTable& GetDispatchTable(Aec3Optimization optimization);
+
+// Returns the dispatch table for the CPU that runs the code. The CPU is only
+// detected on the first call.
+const DispatchTable& GetDispatchTable();
+
+}  // namespace webrtc
+
+#endif  // DISPATCH_TABLE_H_
@@ -16,10 +16,24 @@ namespace webrtc {
 
 DownsampledRenderBuffer::DownsampledRenderBuffer(size_t downsampled_buffer_size)
     : size(static_cast<int>(downsampled_buffer_size)),
-      buffer(downsampled_buffer_size, 0.f) {
+      buffer(2 * downsampled_buffer_size, 0.f) {
   std::fill(buffer.begin(), buffer.end(), 0.f);
 }
 
 DownsampledRenderBuffer::~DownsampledRenderBuffer() = default;
 
+void DownsampledRenderBuffer::WriteReversed(rtc::ArrayView<const float> x) {
+  // The buffer size is a multiple of the sub-block size, so a sub-block never
+  // wraps around.
+  RTC_DCHECK_LE(write + x.size(), static_cast<size_t>(size));
+  std::copy(x.rbegin(), x.rend(), buffer.begin() + write);
+  std::copy(x.rbegin(), x.rend(), buffer.begin() + write + size);
+}
+
+void DownsampledRenderBuffer::Clear() {
+  std::fill(buffer.begin(), buffer.end(), 0.f);
+  read = 0;
+  write = 0;
+}
+
 }  // namespace webrtc
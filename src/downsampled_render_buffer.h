@@ -15,28 +15,32 @@
 
 #include <vector>
 
+#include "array_view.h"
 #include "checks.h"
 
 namespace webrtc {
 
-// Holds the circular buffer of the downsampled render data.
+// Holds the circular buffer of the downsampled render data. The buffer is
+// mirrored: the |size| samples of the circular buffer are followed by a copy
+// of themselves, so that any window of at most |size| samples that starts
+// within the circular buffer is contiguous in memory.
 struct DownsampledRenderBuffer {
   explicit DownsampledRenderBuffer(size_t downsampled_buffer_size);
   ~DownsampledRenderBuffer();
 
   int IncIndex(int index) const {
-    RTC_DCHECK_EQ(buffer.size(), static_cast<size_t>(size));
+    RTC_DCHECK_EQ(buffer.size(), 2 * static_cast<size_t>(size));
     return index < size - 1 ? index + 1 : 0;
   }
 
   int DecIndex(int index) const {
-    RTC_DCHECK_EQ(buffer.size(), static_cast<size_t>(size));
+    RTC_DCHECK_EQ(buffer.size(), 2 * static_cast<size_t>(size));
     return index > 0 ? index - 1 : size - 1;
   }
 
   int OffsetIndex(int index, int offset) const {
-    RTC_DCHECK_GE(buffer.size(), offset);
-    RTC_DCHECK_EQ(buffer.size(), static_cast<size_t>(size));
+    RTC_DCHECK_GE(size, offset);
+    RTC_DCHECK_EQ(buffer.size(), 2 * static_cast<size_t>(size));
     return (size + index + offset) % size;
   }
 
@@ -47,6 +51,12 @@ struct DownsampledRenderBuffer {
   void IncReadIndex() { read = IncIndex(read); }
   void DecReadIndex() { read = DecIndex(read); }
 
+  // Stores |x| in reverse order at the write index and at its mirror.
+  void WriteReversed(rtc::ArrayView<const float> x);
+
+  // Zeroes the samples and the indices.
+  void Clear();
+
   const int size;
   std::vector<float> buffer;
   int write = 0;
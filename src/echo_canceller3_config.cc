@@ -108,8 +108,20 @@ bool EchoCanceller3Config::Validate(EchoCanceller3Config* config) {
     res = false;
   }
 
+  if (c->delay.fine_down_sampling_factor != 0 &&
+      ((c->delay.fine_down_sampling_factor != 2 &&
+        c->delay.fine_down_sampling_factor != 4) ||
+       c->delay.fine_down_sampling_factor >= c->delay.down_sampling_factor)) {
+    c->delay.fine_down_sampling_factor = 0;
+    res = false;
+  }
+
   res = res & Limit(&c->delay.default_delay, 0, 5000);
   res = res & Limit(&c->delay.num_filters, 0, 5000);
+  res = res & Limit(&c->delay.num_fine_filters, 1, 5000);
+  res = res & Limit(&c->delay.steady_state_probe_interval_blocks, 0, 5000);
+  res = res & Limit(&c->delay.num_filter_threads, 1, 64);
+  res = res & Limit(&c->delay.num_delay_candidates, 0, 100);
   res = res & Limit(&c->delay.delay_headroom_samples, 0, 5000);
   res = res & Limit(&c->delay.hysteresis_limit_blocks, 0, 5000);
   res = res & Limit(&c->delay.fixed_capture_delay_samples, 0, 5000);
@@ -39,6 +39,23 @@ struct RTC_EXPORT EchoCanceller3Config {
     size_t default_delay = 5;
     size_t down_sampling_factor = 4;
     size_t num_filters = 5;
+    // Down-sampling factor of the narrow second stage of the delay search.
+    // Zero disables the second stage.
+    size_t fine_down_sampling_factor = 0;
+    size_t num_fine_filters = 2;
+    // Once the delay has converged, only the filters that cover it are
+    // updated, and all the filters are only updated every this many blocks to
+    // detect changes of the delay. Zero updates all the filters on every block.
+    size_t steady_state_probe_interval_blocks = 0;
+    // Number of threads that update the filters of the first stage, including
+    // the calling one.
+    size_t num_filter_threads = 1;
+    // Number of delay candidates reported for multiple echo paths. Zero stops
+    // the filters from voting for the candidates.
+    size_t num_delay_candidates = 0;
+    // Decimate the signals with linear-phase FIR filters, which only compute
+    // the kept samples, instead of cascades of biquads.
+    bool use_fir_decimator = false;
     size_t delay_headroom_samples = 32;
     size_t hysteresis_limit_blocks = 1;
     size_t fixed_capture_delay_samples = 0;
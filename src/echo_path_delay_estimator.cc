@@ -9,15 +9,43 @@
  */
 #include "echo_path_delay_estimator.h"
 
+#include <algorithm>
 #include <array>
+#include <utility>
 
 #include "aec3_common.h"
 #include "apm_data_dumper.h"
 #include "checks.h"
+#include "dispatch_table.h"
 #include "downsampled_render_buffer.h"
 #include "echo_canceller3_config.h"
 
 namespace webrtc {
+namespace {
+
+// Size of the filters used by the second stage of the delay search, which only
+// have to cover the uncertainty of the first stage estimate.
+constexpr size_t kFineMatchedFilterWindowSizeSubBlocks = 8;
+constexpr size_t kFineMatchedFilterAlignmentShiftSizeSubBlocks =
+    kFineMatchedFilterWindowSizeSubBlocks * 3 / 4;
+
+// Returns the index of the updated and reliable lag estimate with the highest
+// accuracy, or -1 if there is none.
+int StrongestFilter(
+    rtc::ArrayView<const MatchedFilter::LagEstimate> lag_estimates) {
+  float best_accuracy = 0.f;
+  int best_index = -1;
+  for (size_t k = 0; k < lag_estimates.size(); ++k) {
+    if (lag_estimates[k].updated && lag_estimates[k].reliable &&
+        lag_estimates[k].accuracy > best_accuracy) {
+      best_accuracy = lag_estimates[k].accuracy;
+      best_index = static_cast<int>(k);
+    }
+  }
+  return best_index;
+}
+
+}  // namespace
 
 EchoPathDelayEstimator::EchoPathDelayEstimator(
     ApmDataDumper* data_dumper,
@@ -30,10 +58,12 @@ EchoPathDelayEstimator::EchoPathDelayEstimator(
                           : kBlockSize),
       capture_mixer_(num_capture_channels,
                      config.delay.capture_alignment_mixing),
-      capture_decimator_(down_sampling_factor_),
+      capture_decimator_(GetDispatchTable().optimization,
+                         down_sampling_factor_,
+                         config.delay.use_fir_decimator),
       matched_filter_(
           data_dumper_,
-          DetectOptimization(),
+          GetDispatchTable().optimization,
           sub_block_size_,
           kMatchedFilterWindowSizeSubBlocks,
           config.delay.num_filters,
@@ -42,23 +72,73 @@ EchoPathDelayEstimator::EchoPathDelayEstimator(
               ? config.render_levels.poor_excitation_render_limit_ds8
               : config.render_levels.poor_excitation_render_limit,
           config.delay.delay_estimate_smoothing,
-          config.delay.delay_candidate_detection_threshold),
+          config.delay.delay_candidate_detection_threshold,
+          config.delay.num_filter_threads),
       matched_filter_lag_aggregator_(data_dumper_,
                                      matched_filter_.GetMaxFilterLag(),
-                                     config.delay.delay_selection_thresholds) {
+                                     config.delay.delay_selection_thresholds,
+                                     config.delay.num_delay_candidates > 0),
+      steady_state_probe_interval_blocks_(
+          config.delay.steady_state_probe_interval_blocks),
+      fine_down_sampling_factor_(config.delay.fine_down_sampling_factor),
+      fine_sub_block_size_(fine_down_sampling_factor_ != 0
+                               ? kBlockSize / fine_down_sampling_factor_
+                               : kBlockSize) {
   RTC_DCHECK(data_dumper);
   RTC_DCHECK(down_sampling_factor_ > 0);
+
+  if (fine_down_sampling_factor_ == 0) {
+    return;
+  }
+
+  RTC_DCHECK_LT(fine_down_sampling_factor_, down_sampling_factor_);
+  fine_capture_decimator_.reset(
+      new Decimator(GetDispatchTable().optimization, fine_down_sampling_factor_,
+                    config.delay.use_fir_decimator));
+  fine_matched_filter_.reset(new MatchedFilter(
+      data_dumper_, GetDispatchTable().optimization, fine_sub_block_size_,
+      kFineMatchedFilterWindowSizeSubBlocks, config.delay.num_fine_filters,
+      kFineMatchedFilterAlignmentShiftSizeSubBlocks,
+      config.render_levels.poor_excitation_render_limit,
+      config.delay.delay_estimate_smoothing,
+      config.delay.delay_candidate_detection_threshold, 1));
+
+  // The lags of the second stage span the same range as those of the first.
+  const size_t max_fine_filter_lag = matched_filter_.GetMaxFilterLag() *
+                                     down_sampling_factor_ /
+                                     fine_down_sampling_factor_;
+  RTC_DCHECK_LE(fine_matched_filter_->GetFilterCoverage(),
+                max_fine_filter_lag);
+  fine_lag_aggregator_.reset(new MatchedFilterLagAggregator(
+      data_dumper_, max_fine_filter_lag,
+      config.delay.delay_selection_thresholds, false));
 }
 
 EchoPathDelayEstimator::~EchoPathDelayEstimator() = default;
 
 void EchoPathDelayEstimator::Reset(bool reset_delay_confidence) {
   Reset(true, reset_delay_confidence);
+  if (reset_delay_confidence) {
+    capture_mixer_.Reset();
+    capture_decimator_.Reset();
+    if (fine_capture_decimator_) {
+      fine_capture_decimator_->Reset();
+    }
+    clockdrift_detector_.Reset();
+  }
 }
 
 absl::optional<DelayEstimate> EchoPathDelayEstimator::EstimateDelay(
     const DownsampledRenderBuffer& render_buffer,
     const std::vector<std::vector<float>>& capture) {
+  RTC_DCHECK(!fine_matched_filter_);
+  return EstimateDelay(render_buffer, render_buffer, capture);
+}
+
+absl::optional<DelayEstimate> EchoPathDelayEstimator::EstimateDelay(
+    const DownsampledRenderBuffer& render_buffer,
+    const DownsampledRenderBuffer& fine_render_buffer,
+    const std::vector<std::vector<float>>& capture) {
   RTC_DCHECK_EQ(kBlockSize, capture[0].size());
 
   std::array<float, kBlockSize> downsampled_capture_data;
@@ -71,12 +151,52 @@ absl::optional<DelayEstimate> EchoPathDelayEstimator::EstimateDelay(
   data_dumper_->DumpWav("aec3_capture_decimator_output",
                         downsampled_capture.size(), downsampled_capture.data(),
                         16000 / down_sampling_factor_, 1);
-  matched_filter_.Update(render_buffer, downsampled_capture);
+
+  // Once the delay has converged, only update the filters that cover it,
+  // except for every steady_state_probe_interval_blocks_ block which updates
+  // all the filters so that a change of the delay is still detected.
+  std::pair<size_t, size_t> steady_state_filters(0, 0);
+  if (steady_state_lag_ &&
+      blocks_since_probe_ + 1 < steady_state_probe_interval_blocks_) {
+    steady_state_filters =
+        matched_filter_.GetFiltersCoveringLag(*steady_state_lag_);
+  }
+  const bool probe = steady_state_filters.first == steady_state_filters.second;
+  if (probe) {
+    matched_filter_.Update(render_buffer, downsampled_capture);
+  } else {
+    matched_filter_.Update(render_buffer, downsampled_capture,
+                           steady_state_filters.first,
+                           steady_state_filters.second);
+  }
+  ++blocks_since_probe_;
 
   absl::optional<DelayEstimate> aggregated_matched_filter_lag =
       matched_filter_lag_aggregator_.Aggregate(
           matched_filter_.GetLagEstimates());
 
+  if (steady_state_probe_interval_blocks_ > 0 &&
+      aggregated_matched_filter_lag &&
+      aggregated_matched_filter_lag->quality ==
+          DelayEstimate::Quality::kRefined) {
+    // Keep updating all the filters for as long as the strongest one does not
+    // cover the converged delay, since the delay has then likely changed.
+    if (probe) {
+      const int strongest_filter =
+          StrongestFilter(matched_filter_.GetLagEstimates());
+      const std::pair<size_t, size_t> filters =
+          matched_filter_.GetFiltersCoveringLag(
+              aggregated_matched_filter_lag->delay);
+      const bool strongest_filter_covers_lag =
+          strongest_filter < 0 ||
+          (static_cast<size_t>(strongest_filter) >= filters.first &&
+           static_cast<size_t>(strongest_filter) < filters.second);
+      blocks_since_probe_ =
+          strongest_filter_covers_lag ? 0 : steady_state_probe_interval_blocks_;
+    }
+    steady_state_lag_ = aggregated_matched_filter_lag->delay;
+  }
+
   // Run clockdrift detection.
   if (aggregated_matched_filter_lag &&
       (*aggregated_matched_filter_lag).quality ==
@@ -110,13 +230,93 @@ absl::optional<DelayEstimate> EchoPathDelayEstimator::EstimateDelay(
     Reset(false, false);
   }
 
+  if (fine_matched_filter_) {
+    return RefineDelay(fine_render_buffer, downmixed_capture,
+                       aggregated_matched_filter_lag);
+  }
+
   return aggregated_matched_filter_lag;
 }
 
+void EchoPathDelayEstimator::GetDelayCandidates(
+    size_t max_candidates,
+    std::vector<MatchedFilterLagAggregator::Candidate>* candidates) const {
+  matched_filter_lag_aggregator_.GetCandidates(max_candidates, candidates);
+  for (auto& candidate : *candidates) {
+    candidate.lag *= down_sampling_factor_;
+  }
+}
+
+absl::optional<DelayEstimate> EchoPathDelayEstimator::RefineDelay(
+    const DownsampledRenderBuffer& fine_render_buffer,
+    rtc::ArrayView<const float, kBlockSize> downmixed_capture,
+    const absl::optional<DelayEstimate>& coarse_estimate) {
+  std::array<float, kBlockSize> downsampled_capture_data;
+  rtc::ArrayView<float> downsampled_capture(downsampled_capture_data.data(),
+                                            fine_sub_block_size_);
+  fine_capture_decimator_->Decimate(downmixed_capture, downsampled_capture);
+
+  // Until the second stage reports, the first stage estimate is passed on as a
+  // coarse one, so that only second stage estimates are refined.
+  absl::optional<DelayEstimate> unrefined_estimate = coarse_estimate;
+  if (unrefined_estimate) {
+    unrefined_estimate->quality = DelayEstimate::Quality::kCoarse;
+  }
+
+  // Center the filters on the first stage estimate once it is refined, and
+  // move them again whenever the estimate drifts away from the center.
+  if (coarse_estimate &&
+      coarse_estimate->quality == DelayEstimate::Quality::kRefined) {
+    const size_t coverage = fine_matched_filter_->GetFilterCoverage();
+    const size_t max_offset = matched_filter_.GetMaxFilterLag() *
+                                  down_sampling_factor_ /
+                                  fine_down_sampling_factor_ -
+                              coverage;
+    const size_t center = coarse_estimate->delay / fine_down_sampling_factor_;
+    const size_t current_center =
+        fine_matched_filter_->GetFilterOffset() + coverage / 2;
+    const size_t distance = center > current_center ? center - current_center
+                                                    : current_center - center;
+    if (!fine_filters_placed_ || distance > coverage / 4) {
+      const size_t offset =
+          std::min(center > coverage / 2 ? center - coverage / 2 : 0,
+                   max_offset);
+      fine_matched_filter_->SetFilterOffset(offset);
+      fine_lag_aggregator_->Reset(true);
+      fine_filters_placed_ = true;
+    }
+  }
+
+  if (!fine_filters_placed_) {
+    return unrefined_estimate;
+  }
+
+  fine_matched_filter_->Update(fine_render_buffer, downsampled_capture);
+  absl::optional<DelayEstimate> fine_estimate =
+      fine_lag_aggregator_->Aggregate(fine_matched_filter_->GetLagEstimates());
+
+  // Only report the second stage estimate once it is as reliable as the first
+  // stage estimate it refines.
+  if (!fine_estimate ||
+      fine_estimate->quality != DelayEstimate::Quality::kRefined) {
+    return unrefined_estimate;
+  }
+
+  fine_estimate->delay *= fine_down_sampling_factor_;
+  return fine_estimate;
+}
+
 void EchoPathDelayEstimator::Reset(bool reset_lag_aggregator,
                                    bool reset_delay_confidence) {
   if (reset_lag_aggregator) {
     matched_filter_lag_aggregator_.Reset(reset_delay_confidence);
+    if (fine_matched_filter_) {
+      fine_matched_filter_->Reset();
+      fine_lag_aggregator_->Reset(true);
+      fine_filters_placed_ = false;
+    }
+    steady_state_lag_ = absl::nullopt;
+    blocks_since_probe_ = 0;
   }
   matched_filter_.Reset();
   old_aggregated_lag_ = absl::nullopt;
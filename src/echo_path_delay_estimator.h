@@ -13,6 +13,9 @@
 
 #include <stddef.h>
 
+#include <memory>
+#include <vector>
+
 #include "absl/types/optional.h"
 #include "alignment_mixer.h"
 #include "array_view.h"
@@ -38,7 +41,8 @@ class EchoPathDelayEstimator {
   ~EchoPathDelayEstimator();
 
   // Resets the estimation. If the delay confidence is reset, the reset behavior
-  // is as if the call is restarted.
+  // is as if the call is restarted, and the state of the capture mixer, the
+  // decimators and the clockdrift detector is cleared as well.
   void Reset(bool reset_delay_confidence);
 
   // Produce a delay estimate if such is avaliable.
@@ -46,6 +50,26 @@ class EchoPathDelayEstimator {
       const DownsampledRenderBuffer& render_buffer,
       const std::vector<std::vector<float>>& capture);
 
+  // Produce a delay estimate if such is avaliable, using a two-stage search.
+  // The first stage searches the full range of delays in |render_buffer| and
+  // the second stage refines the estimate of the first stage using a few
+  // filters centered on it in |fine_render_buffer|, which holds the render
+  // signal at the fine down-sampling factor. Until the second stage has an
+  // estimate of its own, the estimate of the first stage is returned as a
+  // coarse one.
+  absl::optional<DelayEstimate> EstimateDelay(
+      const DownsampledRenderBuffer& render_buffer,
+      const DownsampledRenderBuffer& fine_render_buffer,
+      const std::vector<std::vector<float>>& capture);
+
+  // Returns at most |max_candidates| delays, in samples, that the first stage
+  // has found in the last blocks, which are the echo paths besides the
+  // estimated delay. The candidates are only tracked if
+  // config.delay.num_delay_candidates is positive.
+  void GetDelayCandidates(
+      size_t max_candidates,
+      std::vector<MatchedFilterLagAggregator::Candidate>* candidates) const;
+
   // Log delay estimator properties.
   void LogDelayEstimationProperties(int sample_rate_hz, size_t shift) const {
     matched_filter_.LogFilterProperties(sample_rate_hz, shift,
@@ -69,9 +93,32 @@ class EchoPathDelayEstimator {
   size_t consistent_estimate_counter_ = 0;
   ClockdriftDetector clockdrift_detector_;
 
+  // Once the delay has converged, only the filters that cover
+  // |steady_state_lag_|, in down-sampled samples, are updated, and all the
+  // filters every |steady_state_probe_interval_blocks_| blocks.
+  const size_t steady_state_probe_interval_blocks_;
+  absl::optional<size_t> steady_state_lag_;
+  size_t blocks_since_probe_ = 0;
+
+  // Second stage of the delay search, only present if a fine down-sampling
+  // factor is configured.
+  const size_t fine_down_sampling_factor_;
+  const size_t fine_sub_block_size_;
+  std::unique_ptr<Decimator> fine_capture_decimator_;
+  std::unique_ptr<MatchedFilter> fine_matched_filter_;
+  std::unique_ptr<MatchedFilterLagAggregator> fine_lag_aggregator_;
+  bool fine_filters_placed_ = false;
+
   // Internal reset method with more granularity.
   void Reset(bool reset_lag_aggregator, bool reset_delay_confidence);
 
+  // Runs the second stage of the search on the downmixed capture block, moving
+  // its filters around the first stage estimate when needed.
+  absl::optional<DelayEstimate> RefineDelay(
+      const DownsampledRenderBuffer& fine_render_buffer,
+      rtc::ArrayView<const float, kBlockSize> downmixed_capture,
+      const absl::optional<DelayEstimate>& coarse_estimate);
+
   RTC_DISALLOW_COPY_AND_ASSIGN(EchoPathDelayEstimator);
 };
 }  // namespace webrtc
@@ -41,35 +41,50 @@ struct FftData {
   }
 
   // Computes the power spectrum of the data.
-  void SpectrumAVX2(rtc::ArrayView<float> power_spectrum) const;
+  void Spectrum(rtc::ArrayView<float> power_spectrum) const {
+    RTC_DCHECK_EQ(kFftLengthBy2Plus1, power_spectrum.size());
+    std::transform(re.begin(), re.end(), im.begin(), power_spectrum.begin(),
+                   [](float a, float b) { return a * a + b * b; });
+  }
 
-  // Computes the power spectrum of the data.
-  void Spectrum(Aec3Optimization optimization,
-                rtc::ArrayView<float> power_spectrum) const {
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+  // Computes the power spectrum of the data, optimized for SSE2.
+  void SpectrumSSE2(rtc::ArrayView<float> power_spectrum) const {
     RTC_DCHECK_EQ(kFftLengthBy2Plus1, power_spectrum.size());
+    constexpr int kNumFourBinBands = kFftLengthBy2 / 4;
+    constexpr int kLimit = kNumFourBinBands * 4;
+    for (size_t k = 0; k < kLimit; k += 4) {
+      const __m128 r = _mm_loadu_ps(&re[k]);
+      const __m128 i = _mm_loadu_ps(&im[k]);
+      const __m128 ii = _mm_mul_ps(i, i);
+      const __m128 rr = _mm_mul_ps(r, r);
+      const __m128 rrii = _mm_add_ps(rr, ii);
+      _mm_storeu_ps(&power_spectrum[k], rrii);
+    }
+    power_spectrum[kFftLengthBy2] = re[kFftLengthBy2] * re[kFftLengthBy2] +
+                                    im[kFftLengthBy2] * im[kFftLengthBy2];
+  }
+#endif
+
+  // Computes the power spectrum of the data, optimized for AVX2.
+  void SpectrumAVX2(rtc::ArrayView<float> power_spectrum) const;
+
+  // Pointer to one of the power spectrum functions.
+  using SpectrumFunction =
+      void (FftData::*)(rtc::ArrayView<float> power_spectrum) const;
+
+  // Returns the power spectrum function for |optimization|.
+  static SpectrumFunction SelectSpectrum(Aec3Optimization optimization) {
     switch (optimization) {
 #if defined(WEBRTC_ARCH_X86_FAMILY)
-      case Aec3Optimization::kSse2: {
-        constexpr int kNumFourBinBands = kFftLengthBy2 / 4;
-        constexpr int kLimit = kNumFourBinBands * 4;
-        for (size_t k = 0; k < kLimit; k += 4) {
-          const __m128 r = _mm_loadu_ps(&re[k]);
-          const __m128 i = _mm_loadu_ps(&im[k]);
-          const __m128 ii = _mm_mul_ps(i, i);
-          const __m128 rr = _mm_mul_ps(r, r);
-          const __m128 rrii = _mm_add_ps(rr, ii);
-          _mm_storeu_ps(&power_spectrum[k], rrii);
-        }
-        power_spectrum[kFftLengthBy2] = re[kFftLengthBy2] * re[kFftLengthBy2] +
-                                        im[kFftLengthBy2] * im[kFftLengthBy2];
-      } break;
+      case Aec3Optimization::kSse2:
+        return &FftData::SpectrumSSE2;
       case Aec3Optimization::kAvx2:
-        SpectrumAVX2(power_spectrum);
-        break;
+      case Aec3Optimization::kAvx512:
+        return &FftData::SpectrumAVX2;
 #endif
       default:
-        std::transform(re.begin(), re.end(), im.begin(), power_spectrum.begin(),
-                       [](float a, float b) { return a * a + b * b; });
+        return &FftData::Spectrum;
     }
   }
 
@@ -0,0 +1,228 @@
+#include "fir_decimator.h"
+
+#if defined(WEBRTC_HAS_NEON)
+#include <arm_neon.h>
+#endif
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <numeric>
+
+#include "checks.h"
+
+namespace webrtc {
+namespace aec3 {
+
+#if defined(WEBRTC_HAS_NEON)
+
+void FirDecimateCore_NEON(size_t down_sampling_factor,
+                          rtc::ArrayView<const float> h,
+                          const float* x,
+                          rtc::ArrayView<float> out) {
+  const size_t h_size = h.size();
+  const size_t h_size_by_4 = h_size >> 2;
+
+  for (size_t k = 0; k < out.size(); ++k, x += down_sampling_factor) {
+    const float* x_p = x;
+    const float* h_p = h.data();
+
+    // Accumulate four taps at a time.
+    float32x4_t s_128 = vdupq_n_f32(0);
+    for (size_t j = h_size_by_4; j > 0; --j, x_p += 4, h_p += 4) {
+      const float32x4_t x_j = vld1q_f32(x_p);
+      const float32x4_t h_j = vld1q_f32(h_p);
+      s_128 = vmlaq_f32(s_128, h_j, x_j);
+    }
+
+    // Sum the components together and add the remaining taps.
+    float* v = reinterpret_cast<float*>(&s_128);
+    float s = v[0] + v[1] + v[2] + v[3];
+    for (size_t j = h_size - h_size_by_4 * 4; j > 0; --j, ++x_p, ++h_p) {
+      s += *h_p * *x_p;
+    }
+
+    out[k] = s;
+  }
+}
+
+#endif
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+
+void FirDecimateCore_SSE2(size_t down_sampling_factor,
+                          rtc::ArrayView<const float> h,
+                          const float* x,
+                          rtc::ArrayView<float> out) {
+  const size_t h_size = h.size();
+  const size_t h_size_by_4 = h_size >> 2;
+
+  for (size_t k = 0; k < out.size(); ++k, x += down_sampling_factor) {
+    const float* x_p = x;
+    const float* h_p = h.data();
+
+    // Accumulate four taps at a time.
+    __m128 s_128 = _mm_set1_ps(0);
+    for (size_t j = h_size_by_4; j > 0; --j, x_p += 4, h_p += 4) {
+      const __m128 x_j = _mm_loadu_ps(x_p);
+      const __m128 h_j = _mm_loadu_ps(h_p);
+      s_128 = _mm_add_ps(s_128, _mm_mul_ps(h_j, x_j));
+    }
+
+    // Sum the components together and add the remaining taps.
+    float* v = reinterpret_cast<float*>(&s_128);
+    float s = v[0] + v[1] + v[2] + v[3];
+    for (size_t j = h_size - h_size_by_4 * 4; j > 0; --j, ++x_p, ++h_p) {
+      s += *h_p * *x_p;
+    }
+
+    out[k] = s;
+  }
+}
+
+#endif
+
+void FirDecimateCore(size_t down_sampling_factor,
+                     rtc::ArrayView<const float> h,
+                     const float* x,
+                     rtc::ArrayView<float> out) {
+  for (size_t k = 0; k < out.size(); ++k, x += down_sampling_factor) {
+    float s = 0.f;
+    for (size_t j = 0; j < h.size(); ++j) {
+      s += h[j] * x[j];
+    }
+    out[k] = s;
+  }
+}
+
+FirDecimateCoreFunction SelectFirDecimateCore(Aec3Optimization optimization) {
+  switch (optimization) {
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+    case Aec3Optimization::kSse2:
+      return &FirDecimateCore_SSE2;
+    case Aec3Optimization::kAvx2:
+    case Aec3Optimization::kAvx512:
+      return &FirDecimateCore_AVX2;
+#endif
+#if defined(WEBRTC_HAS_NEON)
+    case Aec3Optimization::kNeon:
+      return &FirDecimateCore_NEON;
+#endif
+    default:
+      return &FirDecimateCore;
+  }
+}
+
+}  // namespace aec3
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+std::vector<float> Reverse(const std::vector<float>& coefficients) {
+  return std::vector<float>(coefficients.rbegin(), coefficients.rend());
+}
+
+// Returns tap n of a Blackman window of |num_taps| taps.
+double BlackmanWindow(size_t n, size_t num_taps) {
+  const double phase = 2.0 * kPi * n / (num_taps - 1);
+  return 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+}
+
+std::vector<float> Scale(const std::vector<double>& h, double gain) {
+  std::vector<float> coefficients(h.size());
+  std::transform(h.begin(), h.end(), coefficients.begin(),
+                 [gain](double v) { return static_cast<float>(v / gain); });
+  return coefficients;
+}
+
+}  // namespace
+
+FirDecimator::FirDecimator(Aec3Optimization optimization,
+                           size_t down_sampling_factor,
+                           const std::vector<float>& coefficients)
+    : decimate_core_(aec3::SelectFirDecimateCore(optimization)),
+      down_sampling_factor_(down_sampling_factor),
+      h_reversed_(Reverse(coefficients)),
+      x_(coefficients.size() - 1, 0.f) {
+  RTC_DCHECK_LT(0, down_sampling_factor_);
+  RTC_DCHECK_LT(0, h_reversed_.size());
+}
+
+FirDecimator::~FirDecimator() = default;
+
+std::vector<float> FirDecimator::LowPassCoefficients(
+    size_t down_sampling_factor,
+    size_t num_taps) {
+  RTC_DCHECK_LT(0, down_sampling_factor);
+  RTC_DCHECK_LT(1, num_taps);
+  const double cutoff = 0.5 / down_sampling_factor;
+  const double center = 0.5 * (num_taps - 1);
+
+  std::vector<double> h(num_taps);
+  for (size_t n = 0; n < num_taps; ++n) {
+    const double t = n - center;
+    const double arg = 2.0 * kPi * cutoff * t;
+    const double sinc = t == 0.0 ? 1.0 : std::sin(arg) / arg;
+    h[n] = sinc * BlackmanWindow(n, num_taps);
+  }
+
+  // Normalize the gain at DC to one.
+  return Scale(h, std::accumulate(h.begin(), h.end(), 0.0));
+}
+
+std::vector<float> FirDecimator::BandPassCoefficients(double low_cutoff,
+                                                      double high_cutoff,
+                                                      size_t num_taps) {
+  RTC_DCHECK_LT(0.0, low_cutoff);
+  RTC_DCHECK_LT(low_cutoff, high_cutoff);
+  RTC_DCHECK_LE(high_cutoff, 0.5);
+  RTC_DCHECK_LT(1, num_taps);
+  const double center = 0.5 * (num_taps - 1);
+
+  // The difference between the ideal low-pass filters at the two cutoffs.
+  std::vector<double> h(num_taps);
+  for (size_t n = 0; n < num_taps; ++n) {
+    const double t = n - center;
+    const double band =
+        t == 0.0 ? 2.0 * (high_cutoff - low_cutoff)
+                 : (std::sin(2.0 * kPi * high_cutoff * t) -
+                    std::sin(2.0 * kPi * low_cutoff * t)) /
+                       (kPi * t);
+    h[n] = band * BlackmanWindow(n, num_taps);
+  }
+
+  // Normalize the gain at the center of the pass band to one.
+  const double omega = kPi * (low_cutoff + high_cutoff);
+  double real = 0.0;
+  double imag = 0.0;
+  for (size_t n = 0; n < num_taps; ++n) {
+    real += h[n] * std::cos(omega * n);
+    imag -= h[n] * std::sin(omega * n);
+  }
+  return Scale(h, std::sqrt(real * real + imag * imag));
+}
+
+void FirDecimator::Decimate(rtc::ArrayView<const float> x,
+                            rtc::ArrayView<float> out) {
+  RTC_DCHECK_EQ(out.size() * down_sampling_factor_, x.size());
+  const size_t history_size = h_reversed_.size() - 1;
+
+  // Append the new samples after the history of the previous call.
+  x_.resize(history_size + x.size());
+  std::copy(x.begin(), x.end(), std::next(x_.begin(), history_size));
+
+  decimate_core_(down_sampling_factor_, h_reversed_, x_.data(), out);
+
+  // Keep the most recent samples as the history of the next call.
+  std::copy(std::prev(x_.end(), history_size), x_.end(), x_.begin());
+}
+
+void FirDecimator::Reset() {
+  x_.assign(h_reversed_.size() - 1, 0.f);
+}
+
+}  // namespace webrtc
@@ -0,0 +1,105 @@
+#ifndef FIR_DECIMATOR_H_
+#define FIR_DECIMATOR_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "aec3_common.h"
+#include "arch.h"
+#include "array_view.h"
+
+namespace webrtc {
+namespace aec3 {
+
+#if defined(WEBRTC_HAS_NEON)
+
+// Filters and decimates a signal that is optimized for NEON.
+void FirDecimateCore_NEON(size_t down_sampling_factor,
+                          rtc::ArrayView<const float> h,
+                          const float* x,
+                          rtc::ArrayView<float> out);
+
+#endif
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+
+// Filters and decimates a signal that is optimized for SSE2.
+void FirDecimateCore_SSE2(size_t down_sampling_factor,
+                          rtc::ArrayView<const float> h,
+                          const float* x,
+                          rtc::ArrayView<float> out);
+
+// Filters and decimates a signal that is optimized for AVX2.
+void FirDecimateCore_AVX2(size_t down_sampling_factor,
+                          rtc::ArrayView<const float> h,
+                          const float* x,
+                          rtc::ArrayView<float> out);
+
+#endif
+
+// Computes out[k] as the dot product of h and the h.size() samples of x that
+// start at x[k * down_sampling_factor]. The coefficients in h are expected to
+// be stored in time-reversed order.
+void FirDecimateCore(size_t down_sampling_factor,
+                     rtc::ArrayView<const float> h,
+                     const float* x,
+                     rtc::ArrayView<float> out);
+
+// Pointer to a filter and decimation function.
+using FirDecimateCoreFunction = void (*)(size_t down_sampling_factor,
+                                         rtc::ArrayView<const float> h,
+                                         const float* x,
+                                         rtc::ArrayView<float> out);
+
+// Returns the filter and decimation function for |optimization|.
+FirDecimateCoreFunction SelectFirDecimateCore(Aec3Optimization optimization);
+
+}  // namespace aec3
+
+// Filters and decimates a signal by an integer factor. Only the
+// output samples that are kept are computed, which makes the filter equivalent
+// to a polyphase decomposition where every phase is evaluated once per output
+// sample.
+class FirDecimator {
+ public:
+  FirDecimator(Aec3Optimization optimization,
+               size_t down_sampling_factor,
+               const std::vector<float>& coefficients);
+  ~FirDecimator();
+  FirDecimator(const FirDecimator&) = delete;
+  FirDecimator& operator=(const FirDecimator&) = delete;
+
+  // Returns the coefficients of a Blackman windowed-sinc low-pass filter with
+  // unity gain at DC and the cutoff at the Nyquist frequency of the decimated
+  // signal.
+  static std::vector<float> LowPassCoefficients(size_t down_sampling_factor,
+                                                size_t num_taps);
+
+  // Returns the coefficients of a Blackman windowed-sinc band-pass filter
+  // with unity gain at the center of the pass band. The cutoffs are fractions
+  // of the sample rate of the input.
+  static std::vector<float> BandPassCoefficients(double low_cutoff,
+                                                 double high_cutoff,
+                                                 size_t num_taps);
+
+  // Decimates x into out. The size of x must be the size of out times the
+  // down-sampling factor.
+  void Decimate(rtc::ArrayView<const float> x, rtc::ArrayView<float> out);
+
+  // Clears the filter state.
+  void Reset();
+
+ private:
+  const aec3::FirDecimateCoreFunction decimate_core_;
+  const size_t down_sampling_factor_;
+  const std::vector<float> h_reversed_;
+
+  // The last h_reversed_.size() - 1 input samples followed by the samples of
+  // the input that is being decimated.
+  std::vector<float> x_;
+};
+
+}  // namespace webrtc
+
+#endif  // FIR_DECIMATOR_H_
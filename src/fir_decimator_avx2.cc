@@ -0,0 +1,41 @@
+#include "fir_decimator.h"
+
+#include <immintrin.h>
+
+namespace webrtc {
+namespace aec3 {
+
+void FirDecimateCore_AVX2(size_t down_sampling_factor,
+                          rtc::ArrayView<const float> h,
+                          const float* x,
+                          rtc::ArrayView<float> out) {
+  const size_t h_size = h.size();
+  const size_t h_size_by_8 = h_size >> 3;
+
+  for (size_t k = 0; k < out.size(); ++k, x += down_sampling_factor) {
+    const float* x_p = x;
+    const float* h_p = h.data();
+
+    // Accumulate eight taps at a time.
+    __m256 s_256 = _mm256_set1_ps(0);
+    for (size_t j = h_size_by_8; j > 0; --j, x_p += 8, h_p += 8) {
+      const __m256 x_j = _mm256_loadu_ps(x_p);
+      const __m256 h_j = _mm256_loadu_ps(h_p);
+      s_256 = _mm256_fmadd_ps(h_j, x_j, s_256);
+    }
+
+    // Sum the components together and add the remaining taps.
+    __m128 s_128 = _mm_add_ps(_mm256_extractf128_ps(s_256, 0),
+                              _mm256_extractf128_ps(s_256, 1));
+    float* v = reinterpret_cast<float*>(&s_128);
+    float s = v[0] + v[1] + v[2] + v[3];
+    for (size_t j = h_size - h_size_by_8 * 8; j > 0; --j, ++x_p, ++h_p) {
+      s += *h_p * *x_p;
+    }
+
+    out[k] = s;
+  }
+}
+
+}  // namespace aec3
+}  // namespace webrtc
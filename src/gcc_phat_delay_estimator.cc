@@ -0,0 +1,113 @@
+#include "gcc_phat_delay_estimator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "checks.h"
+
+namespace webrtc {
+namespace {
+
+// Frames are made this many times longer than the longest delay, so that
+// most of every render frame is still present in the capture frame.
+constexpr size_t kFrameSizePerMaxDelay = 4;
+
+constexpr size_t kMinFrameSize = 64;
+
+size_t FrameSize(size_t max_delay) {
+  size_t frame_size = kMinFrameSize;
+  while (frame_size < kFrameSizePerMaxDelay * max_delay)
+    frame_size <<= 1;
+  return frame_size;
+}
+
+}  // namespace
+
+GccPhatDelayEstimator::GccPhatDelayEstimator(size_t max_delay)
+    : max_delay_(max_delay),
+      fft_(FrameSize(max_delay)),
+      render_frame_(fft_.size()),
+      capture_frame_(fft_.size()),
+      cross_spectrum_(fft_.size()) {}
+
+GccPhatDelayEstimator::~GccPhatDelayEstimator() = default;
+
+absl::optional<size_t> GccPhatDelayEstimator::EstimateDelay(
+    rtc::ArrayView<const float> render,
+    rtc::ArrayView<const float> capture) {
+  const size_t frame_size = fft_.size();
+  const size_t hop_size = frame_size / 2;
+  const size_t length = std::min(render.size(), capture.size());
+
+  std::fill(cross_spectrum_.begin(), cross_spectrum_.end(), 0.f);
+  for (size_t offset = 0; offset < length; offset += hop_size)
+    AccumulateFrame(render, capture, offset);
+
+  // Whiten the spectrum so that every frequency weighs the same in the
+  // correlation. The DC and Nyquist bins carry no delay information.
+  bool has_content = false;
+  cross_spectrum_[0] = 0.f;
+  cross_spectrum_[1] = 0.f;
+  for (size_t k = 2; k < frame_size; k += 2) {
+    const float magnitude = std::sqrt(cross_spectrum_[k] * cross_spectrum_[k] +
+                                      cross_spectrum_[k + 1] *
+                                          cross_spectrum_[k + 1]);
+    if (magnitude > 0.f) {
+      cross_spectrum_[k] /= magnitude;
+      cross_spectrum_[k + 1] /= magnitude;
+      has_content = true;
+    }
+  }
+  if (!has_content)
+    return absl::nullopt;
+
+  fft_.InverseFft(cross_spectrum_.data());
+
+  // Pick the strongest lag, regardless of the polarity of the capture signal.
+  const size_t num_lags = std::min(max_delay_ + 1, hop_size);
+  size_t best_lag = 0;
+  float best_value = 0.f;
+  for (size_t lag = 0; lag < num_lags; ++lag) {
+    const float value = std::fabs(cross_spectrum_[lag]);
+    if (value > best_value) {
+      best_value = value;
+      best_lag = lag;
+    }
+  }
+  return best_lag;
+}
+
+void GccPhatDelayEstimator::AccumulateFrame(
+    rtc::ArrayView<const float> render,
+    rtc::ArrayView<const float> capture,
+    size_t offset) {
+  const size_t frame_size = fft_.size();
+  RTC_DCHECK_LT(offset, std::min(render.size(), capture.size()));
+
+  const size_t num_render = std::min(frame_size, render.size() - offset);
+  const size_t num_capture = std::min(frame_size, capture.size() - offset);
+  std::copy(render.begin() + offset, render.begin() + offset + num_render,
+            render_frame_.begin());
+  std::fill(render_frame_.begin() + num_render, render_frame_.end(), 0.f);
+  std::copy(capture.begin() + offset, capture.begin() + offset + num_capture,
+            capture_frame_.begin());
+  std::fill(capture_frame_.begin() + num_capture, capture_frame_.end(), 0.f);
+
+  fft_.Fft(render_frame_.data());
+  fft_.Fft(capture_frame_.data());
+
+  // Add conj(R) * C. As the Ooura transform computes the imaginary parts with
+  // a positive sine, this is the spectrum whose inverse transform peaks at the
+  // lag by which the capture signal trails the render signal.
+  const float* r = render_frame_.data();
+  const float* c = capture_frame_.data();
+  float* s = cross_spectrum_.data();
+  s[0] += r[0] * c[0];
+  s[1] += r[1] * c[1];
+  for (size_t k = 2; k < frame_size; k += 2) {
+    s[k] += r[k] * c[k] + r[k + 1] * c[k + 1];
+    s[k + 1] += r[k] * c[k + 1] - r[k + 1] * c[k];
+  }
+}
+
+}  // namespace webrtc
@@ -0,0 +1,54 @@
+#ifndef GCC_PHAT_DELAY_ESTIMATOR_H_
+#define GCC_PHAT_DELAY_ESTIMATOR_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "array_view.h"
+#include "ooura_real_fft.h"
+
+namespace webrtc {
+
+// Estimates the delay between two complete signals from their generalized
+// cross-correlation with phase transform weighting (GCC-PHAT). The signals are
+// split into half-overlapping frames, the cross-power spectra of all frames are
+// summed, and the whitened cross-correlation is searched for its peak. The cost
+// grows as O(N log N) with the frame size, and linearly with the length of the
+// signals.
+class GccPhatDelayEstimator {
+ public:
+  // Searches for delays of up to |max_delay| samples.
+  explicit GccPhatDelayEstimator(size_t max_delay);
+  ~GccPhatDelayEstimator();
+  GccPhatDelayEstimator(const GccPhatDelayEstimator&) = delete;
+  GccPhatDelayEstimator& operator=(const GccPhatDelayEstimator&) = delete;
+
+  // Returns the delay, in samples, by which |capture| lags |render|. Returns
+  // nothing if the signals have no frequency content in common.
+  absl::optional<size_t> EstimateDelay(rtc::ArrayView<const float> render,
+                                       rtc::ArrayView<const float> capture);
+
+  // Returns the length of the frames that are transformed.
+  size_t frame_size() const { return fft_.size(); }
+
+ private:
+  // Adds the cross-power spectrum of the frames starting at |offset| to
+  // cross_spectrum_. Samples past the end of the signals are taken as zero.
+  void AccumulateFrame(rtc::ArrayView<const float> render,
+                       rtc::ArrayView<const float> capture,
+                       size_t offset);
+
+  const size_t max_delay_;
+  const OouraRealFft fft_;
+  std::vector<float> render_frame_;
+  std::vector<float> capture_frame_;
+
+  // Sum of the cross-power spectra, in the layout of the OouraRealFft output.
+  std::vector<float> cross_spectrum_;
+};
+
+}  // namespace webrtc
+
+#endif  // GCC_PHAT_DELAY_ESTIMATOR_H_
@@ -17,6 +17,12 @@
 // Compile time constants
 static const constexpr char* default_num_filter = "10";
 static const constexpr char* default_down_sampling_factor = "8";
+static const constexpr char* default_fine_down_sampling_factor = "0";
+static const constexpr char* default_probe_interval = "0";
+static const constexpr char* default_num_threads = "1";
+static const constexpr char* default_stable_blocks = "0";
+static const constexpr char* default_max_seconds = "0";
+static const constexpr char* default_engine = "matched-filter";
 
 static bool exists(const std::string& filename) {
   std::ifstream file_to_test(filename);
@@ -30,11 +36,25 @@ int main(int argc, char* argv[]) {
   std::string render_filename, capture_filename;
 
   // Arguments used when recognizing delay
-  size_t num_filters, down_sampling_factor;
+  size_t num_filters, down_sampling_factor, fine_down_sampling_factor;
+  size_t probe_interval, num_threads;
+
+  // Arguments used when deciding how much of the input to process
+  size_t stable_blocks;
+  float max_seconds;
+
+  // Name of the algorithm used when estimating
+  std::string engine;
 
   // Whether the output should be brief
   bool verbose_output = false;
 
+  // Whether every estimate should be printed instead of the last one
+  bool timeline_output = false;
+
+  // Whether the signals are decimated with FIR filters
+  bool fir_decimator = false;
+
   // Parse command line arguments
   try {
     // clang-format butchers readability when defining options so it is better
@@ -45,10 +65,26 @@ int main(int argc, char* argv[]) {
       ("h,help", "Display help message.")
       ("v,verbose", "Makes this program talk more.",
           cxxopts::value(verbose_output))
+      ("l,timeline", "Print every estimate produced along the way instead of the final one.",
+          cxxopts::value(timeline_output))
       ("f,filter", "Number of filters to use when recognizing delay.",
           cxxopts::value(num_filters)->default_value(default_num_filter))
       ("d,downsampling-factor", "Down-sampling factor to use when recognizing delay.",
           cxxopts::value(down_sampling_factor)->default_value(default_down_sampling_factor))
+      ("r,fine-downsampling-factor", "Refine the delay with a second search stage at this down-sampling factor (0 disables it).",
+          cxxopts::value(fine_down_sampling_factor)->default_value(default_fine_down_sampling_factor))
+      ("p,probe-interval", "Once the delay has converged, only update the filters around it, and all of them every this many blocks (0 always updates all of them).",
+          cxxopts::value(probe_interval)->default_value(default_probe_interval))
+      ("j,threads", "Split the filters between this many threads.",
+          cxxopts::value(num_threads)->default_value(default_num_threads))
+      ("i,fir-decimator", "Decimate with linear-phase FIR filters instead of biquads.",
+          cxxopts::value(fir_decimator))
+      ("s,stable-blocks", "Stop once a refined delay has been stable for this many blocks (0 processes everything).",
+          cxxopts::value(stable_blocks)->default_value(default_stable_blocks))
+      ("t,max-seconds", "Process at most this many seconds of audio (0 processes everything).",
+          cxxopts::value(max_seconds)->default_value(default_max_seconds))
+      ("e,engine", "Algorithm to use, either \"matched-filter\" or \"gcc-phat\".",
+          cxxopts::value(engine)->default_value(default_engine))
       ("render", "Path to the \"rendered\" WAV file.",
           cxxopts::value(render_filename))
       ("capture", "Path to the \"captured\" WAV file.",
@@ -72,6 +108,22 @@ int main(int argc, char* argv[]) {
       std::exit(2);
     }
 
+    if (engine != "matched-filter" && engine != "gcc-phat") {
+      std::cerr << "Unknown engine: " << engine << std::endl;
+      std::exit(2);
+    }
+
+    // The timeline is made of the estimates of the matched filters
+    if (engine == "gcc-phat" && timeline_output) {
+      std::cerr << "The gcc-phat engine cannot print a timeline." << std::endl;
+      std::exit(2);
+    }
+
+    if (num_threads == 0) {
+      std::cerr << "At least one thread is needed." << std::endl;
+      std::exit(2);
+    }
+
   } catch (const cxxopts::OptionException& e) {
     std::cerr << "Unable to parse options: " << e.what() << std::endl;
     std::exit(255);
@@ -141,12 +193,48 @@ int main(int argc, char* argv[]) {
   Setting setting;
   setting.down_sampling_factor = down_sampling_factor;
   setting.num_filters = num_filters;
+  setting.fine_down_sampling_factor = fine_down_sampling_factor;
+  setting.steady_state_probe_interval_blocks = probe_interval;
+  setting.num_filter_threads = num_threads;
+  setting.use_fir_decimator = fir_decimator;
+  setting.stable_blocks_to_stop = stable_blocks;
+  setting.max_duration_seconds = max_seconds;
+  setting.engine = engine == "gcc-phat" ? Setting::Engine::kGccPhat
+                                        : Setting::Engine::kMatchedFilter;
 
   if (verbose_output)
     std::cout << "Using the following settings:" << std::endl
               << "  - Down sampling factor: " << setting.down_sampling_factor
               << std::endl
-              << "  - Delay filters: " << setting.num_filters << std::endl;
+              << "  - Delay filters: " << setting.num_filters << std::endl
+              << "  - Fine down sampling factor: "
+              << setting.fine_down_sampling_factor << std::endl
+              << "  - Steady state probe interval: "
+              << setting.steady_state_probe_interval_blocks << " blocks"
+              << std::endl
+              << "  - Filter threads: " << setting.num_filter_threads
+              << std::endl
+              << "  - Decimator: "
+              << (setting.use_fir_decimator ? "FIR" : "biquads") << std::endl
+              << "  - Stable blocks to stop: " << setting.stable_blocks_to_stop
+              << std::endl
+              << "  - Max duration: " << setting.max_duration_seconds << "s"
+              << std::endl
+              << "  - Engine: " << engine << std::endl;
+
+  // Print one line per estimate: block, delay, quality, blocks since the last
+  // change and clock drift level
+  if (timeline_output) {
+    auto timeline = EstimateDelayTimeline(render_info, capture_info, setting);
+    for (size_t i = 0; i < timeline.size(); i++)
+      std::cout << timeline.block_index[i] << " " << timeline.delay[i] << " "
+                << (timeline.quality[i] == DelayEstimate::Quality::kRefined
+                        ? "refined"
+                        : "coarse")
+                << " " << timeline.blocks_since_last_change[i] << " "
+                << static_cast<int>(timeline.clockdrift[i]) << std::endl;
+    return 0;
+  }
 
   try {
     auto result = EstimateDelay(render_info, capture_info, setting);
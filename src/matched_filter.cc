@@ -20,14 +20,17 @@
 #endif
 #include <algorithm>
 #include <cstddef>
-#include <initializer_list>
-#include <iterator>
+#include <cstdint>
+#include <cstring>
 #include <numeric>
+#include <string>
+#include <utility>
 
 #include "apm_data_dumper.h"
 #include "checks.h"
 #include "downsampled_render_buffer.h"
 #include "logging.h"
+#include "partitioned_thread_pool.h"
 
 namespace webrtc {
 namespace aec3 {
@@ -43,8 +46,10 @@ void MatchedFilterCore_NEON(size_t x_start_index,
                             bool* filters_updated,
                             float* error_sum) {
   const int h_size = static_cast<int>(h.size());
-  const int x_size = static_cast<int>(x.size());
+  // The size of the circular buffer that x mirrors.
+  const size_t x_size = x.size() / 2;
   RTC_DCHECK_EQ(0, h_size % 4);
+  RTC_DCHECK_GE(x_size, h.size());
 
   // Process for all samples in the sub-block.
   for (size_t i = 0; i < y.size(); ++i) {
@@ -57,43 +62,22 @@ void MatchedFilterCore_NEON(size_t x_start_index,
     // Initialize values for the accumulation.
     float32x4_t s_128 = vdupq_n_f32(0);
     float32x4_t x2_sum_128 = vdupq_n_f32(0);
-    float x2_sum = 0.f;
-    float s = 0;
-
-    // Compute loop chunk sizes until, and after, the wraparound of the circular
-    // buffer for x.
-    const int chunk1 =
-        std::min(h_size, static_cast<int>(x_size - x_start_index));
-
-    // Perform the loop in two chunks.
-    const int chunk2 = h_size - chunk1;
-    for (int limit : {chunk1, chunk2}) {
-      // Perform 128 bit vector operations.
-      const int limit_by_4 = limit >> 2;
-      for (int k = limit_by_4; k > 0; --k, h_p += 4, x_p += 4) {
-        // Load the data into 128 bit vectors.
-        const float32x4_t x_k = vld1q_f32(x_p);
-        const float32x4_t h_k = vld1q_f32(h_p);
-        // Compute and accumulate x * x and h * x.
-        x2_sum_128 = vmlaq_f32(x2_sum_128, x_k, x_k);
-        s_128 = vmlaq_f32(s_128, h_k, x_k);
-      }
 
-      // Perform non-vector operations for any remaining items.
-      for (int k = limit - limit_by_4 * 4; k > 0; --k, ++h_p, ++x_p) {
-        const float x_k = *x_p;
-        x2_sum += x_k * x_k;
-        s += *h_p * x_k;
-      }
-
-      x_p = &x[0];
+    // Perform 128 bit vector operations.
+    for (int k = h_size >> 2; k > 0; --k, h_p += 4, x_p += 4) {
+      // Load the data into 128 bit vectors.
+      const float32x4_t x_k = vld1q_f32(x_p);
+      const float32x4_t h_k = vld1q_f32(h_p);
+      // Compute and accumulate x * x and h * x.
+      x2_sum_128 = vmlaq_f32(x2_sum_128, x_k, x_k);
+      s_128 = vmlaq_f32(s_128, h_k, x_k);
     }
 
-    // Combine the accumulated vector and scalar values.
+    // Combine the accumulated vector values.
     float* v = reinterpret_cast<float*>(&x2_sum_128);
-    x2_sum += v[0] + v[1] + v[2] + v[3];
+    const float x2_sum = v[0] + v[1] + v[2] + v[3];
     v = reinterpret_cast<float*>(&s_128);
-    s += v[0] + v[1] + v[2] + v[3];
+    const float s = v[0] + v[1] + v[2] + v[3];
 
     // Compute the matched filter error.
     float e = y[i] - s;
@@ -110,34 +94,220 @@ void MatchedFilterCore_NEON(size_t x_start_index,
       float* h_p = &h[0];
       x_p = &x[x_start_index];
 
-      // Perform the loop in two chunks.
-      for (int limit : {chunk1, chunk2}) {
-        // Perform 128 bit vector operations.
-        const int limit_by_4 = limit >> 2;
-        for (int k = limit_by_4; k > 0; --k, h_p += 4, x_p += 4) {
+      // Perform 128 bit vector operations.
+      for (int k = h_size >> 2; k > 0; --k, h_p += 4, x_p += 4) {
+        // Load the data into 128 bit vectors.
+        float32x4_t h_k = vld1q_f32(h_p);
+        const float32x4_t x_k = vld1q_f32(x_p);
+        // Compute h = h + alpha * x.
+        h_k = vmlaq_f32(h_k, alpha_128, x_k);
+
+        // Store the result.
+        vst1q_f32(h_p, h_k);
+      }
+
+      *filters_updated = true;
+    }
+
+    x_start_index = x_start_index > 0 ? x_start_index - 1 : x_size - 1;
+  }
+}
+
+template <size_t kSubBlockSize, size_t kFilterLength, size_t kFilterShift>
+void MatchedFilterBankCore_NEON(size_t x_start_index,
+                                size_t filter_shift,
+                                float x2_sum_threshold,
+                                float smoothing,
+                                rtc::ArrayView<const float> x,
+                                rtc::ArrayView<const float> y,
+                                rtc::ArrayView<float> h,
+                                rtc::ArrayView<bool> filters_updated,
+                                rtc::ArrayView<float> error_sums,
+                                rtc::ArrayView<float> x2_sums) {
+  const size_t num_filters = error_sums.size();
+  // The sizes that are known at compile time replace the given ones.
+  const size_t sub_block_size = kSubBlockSize > 0 ? kSubBlockSize : y.size();
+  const int h_size = static_cast<int>(
+      kFilterLength > 0 ? kFilterLength : h.size() / num_filters);
+  const int shift =
+      static_cast<int>(kFilterShift > 0 ? kFilterShift : filter_shift);
+  // The number of samples that each filter shares with the next one.
+  const int overlap = h_size > shift ? h_size - shift : 0;
+  // The size of the circular buffer that x mirrors.
+  const size_t x_size = x.size() / 2;
+  RTC_DCHECK_EQ(0, h_size % 4);
+  RTC_DCHECK_EQ(0, overlap % 4);
+  RTC_DCHECK_LE(2 * overlap, h_size);
+  RTC_DCHECK_GE(x_size, (num_filters - 1) * shift + h_size);
+  RTC_DCHECK_EQ(sub_block_size, y.size());
+  RTC_DCHECK_EQ(num_filters * h_size, h.size());
+  RTC_DCHECK_EQ(static_cast<size_t>(shift), filter_shift);
+  RTC_DCHECK_EQ(num_filters, filters_updated.size());
+  RTC_DCHECK_EQ(num_filters, error_sums.size());
+  RTC_DCHECK_EQ(num_filters, x2_sums.size());
+
+  // Apply the filters in groups that fit in the L1 cache, so that every group
+  // can be applied to the whole sub-block. Only the filters within a group
+  // share their overlaps.
+  const size_t group_size =
+      std::max<size_t>(1, kMatchedFilterBankGroupSamples / h_size);
+  for (size_t first = 0; first < num_filters; first += group_size) {
+    const size_t last = std::min(num_filters, first + group_size);
+
+    // Compute x * x for the first sample in the sub-block, computing the
+    // overlap of adjacent filters once.
+    float32x4_t x2_sum_128 = vdupq_n_f32(0);
+    for (size_t n = first; n < last; ++n) {
+      const float* x_p = &x[x_start_index + n * shift];
+      const int begin = n > first ? overlap : 0;
+      const int end = n + 1 < last ? h_size - overlap : h_size;
+      for (int k = begin; k < end; k += 4) {
+        const float32x4_t x_k = vld1q_f32(x_p + k);
+        x2_sum_128 = vmlaq_f32(x2_sum_128, x_k, x_k);
+      }
+
+      float32x4_t next_x2_sum_128 = vdupq_n_f32(0);
+      for (int k = end; k < h_size; k += 4) {
+        const float32x4_t x_k = vld1q_f32(x_p + k);
+        next_x2_sum_128 = vmlaq_f32(next_x2_sum_128, x_k, x_k);
+      }
+      x2_sum_128 = vaddq_f32(x2_sum_128, next_x2_sum_128);
+
+      float* v = reinterpret_cast<float*>(&x2_sum_128);
+      x2_sums[n] = v[0] + v[1] + v[2] + v[3];
+      x2_sum_128 = next_x2_sum_128;
+    }
+
+    // Process for all samples in the sub-block.
+    size_t x_index = x_start_index;
+    for (size_t i = 0; i < sub_block_size; ++i) {
+      RTC_DCHECK_GT(x_size, x_index);
+      const bool saturation = y[i] >= 32000.f || y[i] <= -32000.f;
+
+      // The accumulated value of the current filter, which may already hold
+      // the overlap with the previous filter.
+      float32x4_t s_128 = vdupq_n_f32(0);
+      for (size_t n = first; n < last; ++n) {
+        const float* x_p = &x[x_index + n * shift];
+        const float* h_p = &h[n * h_size];
+
+        // Apply the matched filter as filter * x for the samples that are not
+        // shared with the previous or the next filter.
+        const int begin = n > first ? overlap : 0;
+        const int end = n + 1 < last ? h_size - overlap : h_size;
+        for (int k = begin; k < end; k += 4) {
           // Load the data into 128 bit vectors.
-          float32x4_t h_k = vld1q_f32(h_p);
-          const float32x4_t x_k = vld1q_f32(x_p);
-          // Compute h = h + alpha * x.
-          h_k = vmlaq_f32(h_k, alpha_128, x_k);
+          const float32x4_t x_k = vld1q_f32(x_p + k);
+          const float32x4_t h_k = vld1q_f32(h_p + k);
+          // Compute and accumulate h * x.
+          s_128 = vmlaq_f32(s_128, h_k, x_k);
+        }
 
-          // Store the result.
-          vst1q_f32(h_p, h_k);
+        // Apply both this and the next filter to the samples they share.
+        float32x4_t next_s_128 = vdupq_n_f32(0);
+        if (n + 1 < last) {
+          const float* next_h_p = &h[(n + 1) * h_size];
+          for (int k = end; k < h_size; k += 4) {
+            const float32x4_t x_k = vld1q_f32(x_p + k);
+            const float32x4_t h_k = vld1q_f32(h_p + k);
+            const float32x4_t next_h_k = vld1q_f32(next_h_p + k - end);
+            s_128 = vmlaq_f32(s_128, h_k, x_k);
+            next_s_128 = vmlaq_f32(next_s_128, next_h_k, x_k);
+          }
         }
 
-        // Perform non-vector operations for any remaining items.
-        for (int k = limit - limit_by_4 * 4; k > 0; --k, ++h_p, ++x_p) {
-          *h_p += alpha * *x_p;
+        // Sum components together.
+        float* v = reinterpret_cast<float*>(&s_128);
+        const float s = v[0] + v[1] + v[2] + v[3];
+        const float x2_sum = x2_sums[n];
+
+        // Compute the matched filter error.
+        float e = y[i] - s;
+        error_sums[n] += e * e;
+
+        // Update the matched filter estimate in an NLMS manner.
+        if (x2_sum > x2_sum_threshold && !saturation) {
+          RTC_DCHECK_LT(0.f, x2_sum);
+          const float alpha = smoothing * e / x2_sum;
+          const float32x4_t alpha_128 = vmovq_n_f32(alpha);
+
+          // filter = filter + smoothing * (y - filter * x) * x / x * x.
+          float* h_p = &h[n * h_size];
+          for (int k = 0; k < h_size; k += 4) {
+            // Load the data into 128 bit vectors.
+            float32x4_t h_k = vld1q_f32(h_p + k);
+            const float32x4_t x_k = vld1q_f32(x_p + k);
+            // Compute h = h + alpha * x.
+            h_k = vmlaq_f32(h_k, alpha_128, x_k);
+
+            // Store the result.
+            vst1q_f32(h_p + k, h_k);
+          }
+          filters_updated[n] = true;
         }
 
-        x_p = &x[0];
+        s_128 = next_s_128;
       }
 
-      *filters_updated = true;
+      // Slide x * x of every filter one sample back.
+      const size_t next_x_index = x_index > 0 ? x_index - 1 : x_size - 1;
+      for (size_t n = first; n < last; ++n) {
+        const float x_in = x[next_x_index + n * shift];
+        const float x_out = x[x_index + n * shift + h_size - 1];
+        x2_sums[n] += x_in * x_in - x_out * x_out;
+      }
+      x_index = next_x_index;
     }
+  }
+}
 
-    x_start_index = x_start_index > 0 ? x_start_index - 1 : x_size - 1;
+#define INSTANTIATE_MATCHED_FILTER_BANK_CORE(sub_block_size, filter_length,   \
+                                             filter_shift)                    \
+  template void                                                               \
+  MatchedFilterBankCore_NEON<sub_block_size, filter_length, filter_shift>(    \
+      size_t, size_t, float, float, rtc::ArrayView<const float>,              \
+      rtc::ArrayView<const float>, rtc::ArrayView<float>,                     \
+      rtc::ArrayView<bool>, rtc::ArrayView<float>, rtc::ArrayView<float>);
+MATCHED_FILTER_BANK_SPECIALIZATIONS(INSTANTIATE_MATCHED_FILTER_BANK_CORE)
+#undef INSTANTIATE_MATCHED_FILTER_BANK_CORE
+
+size_t MaxSquarePeakIndex_NEON(rtc::ArrayView<const float> h) {
+  const int h_size = static_cast<int>(h.size());
+  RTC_DCHECK_EQ(0, h_size % 4);
+  RTC_DCHECK_LT(0, h_size);
+
+  // Track the largest square and its index in each lane. A lane only moves to
+  // a later index when its square is strictly larger, which keeps the first
+  // one of equal squares.
+  const float32x4_t h_0 = vld1q_f32(&h[0]);
+  float32x4_t max_128 = vmulq_f32(h_0, h_0);
+  const uint32_t kFirstIndices[4] = {0, 1, 2, 3};
+  uint32x4_t index_128 = vld1q_u32(kFirstIndices);
+  uint32x4_t max_index_128 = index_128;
+  const uint32x4_t step_128 = vdupq_n_u32(4);
+  for (int k = 4; k < h_size; k += 4) {
+    const float32x4_t h_k = vld1q_f32(&h[k]);
+    const float32x4_t square = vmulq_f32(h_k, h_k);
+    index_128 = vaddq_u32(index_128, step_128);
+    const uint32x4_t larger = vcgtq_f32(square, max_128);
+    max_128 = vbslq_f32(larger, square, max_128);
+    max_index_128 = vbslq_u32(larger, index_128, max_index_128);
+  }
+
+  // Combine the lanes, preferring the lowest index among equal squares.
+  float max[4];
+  uint32_t max_index[4];
+  vst1q_f32(max, max_128);
+  vst1q_u32(max_index, max_index_128);
+  size_t peak_index = max_index[0];
+  float peak = max[0];
+  for (int k = 1; k < 4; ++k) {
+    if (max[k] > peak || (max[k] == peak && max_index[k] < peak_index)) {
+      peak = max[k];
+      peak_index = max_index[k];
+    }
   }
+  return peak_index;
 }
 
 #endif
@@ -153,8 +323,10 @@ void MatchedFilterCore_SSE2(size_t x_start_index,
                             bool* filters_updated,
                             float* error_sum) {
   const int h_size = static_cast<int>(h.size());
-  const int x_size = static_cast<int>(x.size());
+  // The size of the circular buffer that x mirrors.
+  const size_t x_size = x.size() / 2;
   RTC_DCHECK_EQ(0, h_size % 4);
+  RTC_DCHECK_GE(x_size, h.size());
 
   // Process for all samples in the sub-block.
   for (size_t i = 0; i < y.size(); ++i) {
@@ -167,45 +339,24 @@ void MatchedFilterCore_SSE2(size_t x_start_index,
     // Initialize values for the accumulation.
     __m128 s_128 = _mm_set1_ps(0);
     __m128 x2_sum_128 = _mm_set1_ps(0);
-    float x2_sum = 0.f;
-    float s = 0;
-
-    // Compute loop chunk sizes until, and after, the wraparound of the circular
-    // buffer for x.
-    const int chunk1 =
-        std::min(h_size, static_cast<int>(x_size - x_start_index));
-
-    // Perform the loop in two chunks.
-    const int chunk2 = h_size - chunk1;
-    for (int limit : {chunk1, chunk2}) {
-      // Perform 128 bit vector operations.
-      const int limit_by_4 = limit >> 2;
-      for (int k = limit_by_4; k > 0; --k, h_p += 4, x_p += 4) {
-        // Load the data into 128 bit vectors.
-        const __m128 x_k = _mm_loadu_ps(x_p);
-        const __m128 h_k = _mm_loadu_ps(h_p);
-        const __m128 xx = _mm_mul_ps(x_k, x_k);
-        // Compute and accumulate x * x and h * x.
-        x2_sum_128 = _mm_add_ps(x2_sum_128, xx);
-        const __m128 hx = _mm_mul_ps(h_k, x_k);
-        s_128 = _mm_add_ps(s_128, hx);
-      }
-
-      // Perform non-vector operations for any remaining items.
-      for (int k = limit - limit_by_4 * 4; k > 0; --k, ++h_p, ++x_p) {
-        const float x_k = *x_p;
-        x2_sum += x_k * x_k;
-        s += *h_p * x_k;
-      }
 
-      x_p = &x[0];
+    // Perform 128 bit vector operations.
+    for (int k = h_size >> 2; k > 0; --k, h_p += 4, x_p += 4) {
+      // Load the data into 128 bit vectors.
+      const __m128 x_k = _mm_loadu_ps(x_p);
+      const __m128 h_k = _mm_loadu_ps(h_p);
+      const __m128 xx = _mm_mul_ps(x_k, x_k);
+      // Compute and accumulate x * x and h * x.
+      x2_sum_128 = _mm_add_ps(x2_sum_128, xx);
+      const __m128 hx = _mm_mul_ps(h_k, x_k);
+      s_128 = _mm_add_ps(s_128, hx);
     }
 
-    // Combine the accumulated vector and scalar values.
+    // Combine the accumulated vector values.
     float* v = reinterpret_cast<float*>(&x2_sum_128);
-    x2_sum += v[0] + v[1] + v[2] + v[3];
+    const float x2_sum = v[0] + v[1] + v[2] + v[3];
     v = reinterpret_cast<float*>(&s_128);
-    s += v[0] + v[1] + v[2] + v[3];
+    const float s = v[0] + v[1] + v[2] + v[3];
 
     // Compute the matched filter error.
     float e = y[i] - s;
@@ -222,37 +373,232 @@ void MatchedFilterCore_SSE2(size_t x_start_index,
       float* h_p = &h[0];
       x_p = &x[x_start_index];
 
-      // Perform the loop in two chunks.
-      for (int limit : {chunk1, chunk2}) {
-        // Perform 128 bit vector operations.
-        const int limit_by_4 = limit >> 2;
-        for (int k = limit_by_4; k > 0; --k, h_p += 4, x_p += 4) {
-          // Load the data into 128 bit vectors.
-          __m128 h_k = _mm_loadu_ps(h_p);
-          const __m128 x_k = _mm_loadu_ps(x_p);
+      // Perform 128 bit vector operations.
+      for (int k = h_size >> 2; k > 0; --k, h_p += 4, x_p += 4) {
+        // Load the data into 128 bit vectors.
+        __m128 h_k = _mm_loadu_ps(h_p);
+        const __m128 x_k = _mm_loadu_ps(x_p);
+
+        // Compute h = h + alpha * x.
+        const __m128 alpha_x = _mm_mul_ps(alpha_128, x_k);
+        h_k = _mm_add_ps(h_k, alpha_x);
+
+        // Store the result.
+        _mm_storeu_ps(h_p, h_k);
+      }
+
+      *filters_updated = true;
+    }
 
-          // Compute h = h + alpha * x.
-          const __m128 alpha_x = _mm_mul_ps(alpha_128, x_k);
-          h_k = _mm_add_ps(h_k, alpha_x);
+    x_start_index = x_start_index > 0 ? x_start_index - 1 : x_size - 1;
+  }
+}
+
+template <size_t kSubBlockSize, size_t kFilterLength, size_t kFilterShift>
+void MatchedFilterBankCore_SSE2(size_t x_start_index,
+                                size_t filter_shift,
+                                float x2_sum_threshold,
+                                float smoothing,
+                                rtc::ArrayView<const float> x,
+                                rtc::ArrayView<const float> y,
+                                rtc::ArrayView<float> h,
+                                rtc::ArrayView<bool> filters_updated,
+                                rtc::ArrayView<float> error_sums,
+                                rtc::ArrayView<float> x2_sums) {
+  const size_t num_filters = error_sums.size();
+  // The sizes that are known at compile time replace the given ones.
+  const size_t sub_block_size = kSubBlockSize > 0 ? kSubBlockSize : y.size();
+  const int h_size = static_cast<int>(
+      kFilterLength > 0 ? kFilterLength : h.size() / num_filters);
+  const int shift =
+      static_cast<int>(kFilterShift > 0 ? kFilterShift : filter_shift);
+  // The number of samples that each filter shares with the next one.
+  const int overlap = h_size > shift ? h_size - shift : 0;
+  // The size of the circular buffer that x mirrors.
+  const size_t x_size = x.size() / 2;
+  RTC_DCHECK_EQ(0, h_size % 4);
+  RTC_DCHECK_EQ(0, overlap % 4);
+  RTC_DCHECK_LE(2 * overlap, h_size);
+  RTC_DCHECK_GE(x_size, (num_filters - 1) * shift + h_size);
+  RTC_DCHECK_EQ(sub_block_size, y.size());
+  RTC_DCHECK_EQ(num_filters * h_size, h.size());
+  RTC_DCHECK_EQ(0u, reinterpret_cast<uintptr_t>(h.data()) % 16);
+  RTC_DCHECK_EQ(static_cast<size_t>(shift), filter_shift);
+  RTC_DCHECK_EQ(num_filters, filters_updated.size());
+  RTC_DCHECK_EQ(num_filters, error_sums.size());
+  RTC_DCHECK_EQ(num_filters, x2_sums.size());
+
+  // Apply the filters in groups that fit in the L1 cache, so that every group
+  // can be applied to the whole sub-block. Only the filters within a group
+  // share their overlaps.
+  const size_t group_size =
+      std::max<size_t>(1, kMatchedFilterBankGroupSamples / h_size);
+  for (size_t first = 0; first < num_filters; first += group_size) {
+    const size_t last = std::min(num_filters, first + group_size);
+
+    // Compute x * x for the first sample in the sub-block, computing the
+    // overlap of adjacent filters once.
+    __m128 x2_sum_128 = _mm_set1_ps(0);
+    for (size_t n = first; n < last; ++n) {
+      const float* x_p = &x[x_start_index + n * shift];
+      const int begin = n > first ? overlap : 0;
+      const int end = n + 1 < last ? h_size - overlap : h_size;
+      for (int k = begin; k < end; k += 4) {
+        const __m128 x_k = _mm_loadu_ps(x_p + k);
+        const __m128 xx = _mm_mul_ps(x_k, x_k);
+        x2_sum_128 = _mm_add_ps(x2_sum_128, xx);
+      }
+
+      __m128 next_x2_sum_128 = _mm_set1_ps(0);
+      for (int k = end; k < h_size; k += 4) {
+        const __m128 x_k = _mm_loadu_ps(x_p + k);
+        const __m128 xx = _mm_mul_ps(x_k, x_k);
+        next_x2_sum_128 = _mm_add_ps(next_x2_sum_128, xx);
+      }
+      x2_sum_128 = _mm_add_ps(x2_sum_128, next_x2_sum_128);
+
+      float* v = reinterpret_cast<float*>(&x2_sum_128);
+      x2_sums[n] = v[0] + v[1] + v[2] + v[3];
+      x2_sum_128 = next_x2_sum_128;
+    }
 
-          // Store the result.
-          _mm_storeu_ps(h_p, h_k);
+    // Process for all samples in the sub-block.
+    size_t x_index = x_start_index;
+    for (size_t i = 0; i < sub_block_size; ++i) {
+      RTC_DCHECK_GT(x_size, x_index);
+      const bool saturation = y[i] >= 32000.f || y[i] <= -32000.f;
+
+      // The accumulated value of the current filter, which may already hold
+      // the overlap with the previous filter.
+      __m128 s_128 = _mm_set1_ps(0);
+      for (size_t n = first; n < last; ++n) {
+        const float* x_p = &x[x_index + n * shift];
+        const float* h_p = &h[n * h_size];
+
+        // Apply the matched filter as filter * x for the samples that are not
+        // shared with the previous or the next filter.
+        const int begin = n > first ? overlap : 0;
+        const int end = n + 1 < last ? h_size - overlap : h_size;
+        for (int k = begin; k < end; k += 4) {
+          // Load the data into 128 bit vectors.
+          const __m128 x_k = _mm_loadu_ps(x_p + k);
+          const __m128 h_k = _mm_load_ps(h_p + k);
+          // Compute and accumulate h * x.
+          const __m128 hx = _mm_mul_ps(h_k, x_k);
+          s_128 = _mm_add_ps(s_128, hx);
         }
 
-        // Perform non-vector operations for any remaining items.
-        for (int k = limit - limit_by_4 * 4; k > 0; --k, ++h_p, ++x_p) {
-          *h_p += alpha * *x_p;
+        // Apply both this and the next filter to the samples they share.
+        __m128 next_s_128 = _mm_set1_ps(0);
+        if (n + 1 < last) {
+          const float* next_h_p = &h[(n + 1) * h_size];
+          for (int k = end; k < h_size; k += 4) {
+            const __m128 x_k = _mm_loadu_ps(x_p + k);
+            const __m128 h_k = _mm_load_ps(h_p + k);
+            const __m128 next_h_k = _mm_load_ps(next_h_p + k - end);
+            const __m128 hx = _mm_mul_ps(h_k, x_k);
+            s_128 = _mm_add_ps(s_128, hx);
+            const __m128 next_hx = _mm_mul_ps(next_h_k, x_k);
+            next_s_128 = _mm_add_ps(next_s_128, next_hx);
+          }
         }
 
-        x_p = &x[0];
+        // Sum components together.
+        float* v = reinterpret_cast<float*>(&s_128);
+        const float s = v[0] + v[1] + v[2] + v[3];
+        const float x2_sum = x2_sums[n];
+
+        // Compute the matched filter error.
+        float e = y[i] - s;
+        error_sums[n] += e * e;
+
+        // Update the matched filter estimate in an NLMS manner.
+        if (x2_sum > x2_sum_threshold && !saturation) {
+          RTC_DCHECK_LT(0.f, x2_sum);
+          const float alpha = smoothing * e / x2_sum;
+          const __m128 alpha_128 = _mm_set1_ps(alpha);
+
+          // filter = filter + smoothing * (y - filter * x) * x / x * x.
+          float* h_p = &h[n * h_size];
+          for (int k = 0; k < h_size; k += 4) {
+            // Load the data into 128 bit vectors.
+            __m128 h_k = _mm_load_ps(h_p + k);
+            const __m128 x_k = _mm_loadu_ps(x_p + k);
+            // Compute h = h + alpha * x.
+            const __m128 alpha_x = _mm_mul_ps(alpha_128, x_k);
+            h_k = _mm_add_ps(h_k, alpha_x);
+
+            // Store the result.
+            _mm_store_ps(h_p + k, h_k);
+          }
+          filters_updated[n] = true;
+        }
+
+        s_128 = next_s_128;
       }
 
-      *filters_updated = true;
+      // Slide x * x of every filter one sample back.
+      const size_t next_x_index = x_index > 0 ? x_index - 1 : x_size - 1;
+      for (size_t n = first; n < last; ++n) {
+        const float x_in = x[next_x_index + n * shift];
+        const float x_out = x[x_index + n * shift + h_size - 1];
+        x2_sums[n] += x_in * x_in - x_out * x_out;
+      }
+      x_index = next_x_index;
     }
+  }
+}
 
-    x_start_index = x_start_index > 0 ? x_start_index - 1 : x_size - 1;
+#define INSTANTIATE_MATCHED_FILTER_BANK_CORE(sub_block_size, filter_length,   \
+                                             filter_shift)                    \
+  template void                                                               \
+  MatchedFilterBankCore_SSE2<sub_block_size, filter_length, filter_shift>(    \
+      size_t, size_t, float, float, rtc::ArrayView<const float>,              \
+      rtc::ArrayView<const float>, rtc::ArrayView<float>,                     \
+      rtc::ArrayView<bool>, rtc::ArrayView<float>, rtc::ArrayView<float>);
+MATCHED_FILTER_BANK_SPECIALIZATIONS(INSTANTIATE_MATCHED_FILTER_BANK_CORE)
+#undef INSTANTIATE_MATCHED_FILTER_BANK_CORE
+
+size_t MaxSquarePeakIndex_SSE2(rtc::ArrayView<const float> h) {
+  const int h_size = static_cast<int>(h.size());
+  RTC_DCHECK_EQ(0, h_size % 4);
+  RTC_DCHECK_LT(0, h_size);
+
+  // Track the largest square and its index in each lane. A lane only moves to
+  // a later index when its square is strictly larger, which keeps the first
+  // one of equal squares.
+  const __m128 h_0 = _mm_loadu_ps(&h[0]);
+  __m128 max_128 = _mm_mul_ps(h_0, h_0);
+  __m128i index_128 = _mm_setr_epi32(0, 1, 2, 3);
+  __m128i max_index_128 = index_128;
+  const __m128i step_128 = _mm_set1_epi32(4);
+  for (int k = 4; k < h_size; k += 4) {
+    const __m128 h_k = _mm_loadu_ps(&h[k]);
+    const __m128 square = _mm_mul_ps(h_k, h_k);
+    index_128 = _mm_add_epi32(index_128, step_128);
+    const __m128i larger = _mm_castps_si128(_mm_cmpgt_ps(square, max_128));
+    max_128 = _mm_max_ps(max_128, square);
+    max_index_128 = _mm_or_si128(_mm_and_si128(larger, index_128),
+                                 _mm_andnot_si128(larger, max_index_128));
+  }
+
+  // Combine the lanes, preferring the lowest index among equal squares.
+  float max[4];
+  int32_t max_index[4];
+  _mm_storeu_ps(max, max_128);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(max_index), max_index_128);
+  size_t peak_index = max_index[0];
+  float peak = max[0];
+  for (int k = 1; k < 4; ++k) {
+    const size_t index = static_cast<size_t>(max_index[k]);
+    if (max[k] > peak || (max[k] == peak && index < peak_index)) {
+      peak = max[k];
+      peak_index = index;
+    }
   }
+  return peak_index;
 }
+
 #endif
 
 void MatchedFilterCore(size_t x_start_index,
@@ -263,16 +609,20 @@ void MatchedFilterCore(size_t x_start_index,
                        rtc::ArrayView<float> h,
                        bool* filters_updated,
                        float* error_sum) {
+  // The size of the circular buffer that x mirrors.
+  const size_t x_size = x.size() / 2;
+  RTC_DCHECK_GE(x_size, h.size());
+
   // Process for all samples in the sub-block.
   for (size_t i = 0; i < y.size(); ++i) {
     // Apply the matched filter as filter * x, and compute x * x.
+    RTC_DCHECK_GT(x_size, x_start_index);
+    const float* x_p = &x[x_start_index];
     float x2_sum = 0.f;
     float s = 0;
-    size_t x_index = x_start_index;
     for (size_t k = 0; k < h.size(); ++k) {
-      x2_sum += x[x_index] * x[x_index];
-      s += h[k] * x[x_index];
-      x_index = x_index < (x.size() - 1) ? x_index + 1 : 0;
+      x2_sum += x_p[k] * x_p[k];
+      s += h[k] * x_p[k];
     }
 
     // Compute the matched filter error.
@@ -286,15 +636,230 @@ void MatchedFilterCore(size_t x_start_index,
       const float alpha = smoothing * e / x2_sum;
 
       // filter = filter + smoothing * (y - filter * x) * x / x * x.
-      size_t x_index = x_start_index;
       for (size_t k = 0; k < h.size(); ++k) {
-        h[k] += alpha * x[x_index];
-        x_index = x_index < (x.size() - 1) ? x_index + 1 : 0;
+        h[k] += alpha * x_p[k];
       }
       *filters_updated = true;
     }
 
-    x_start_index = x_start_index > 0 ? x_start_index - 1 : x.size() - 1;
+    x_start_index = x_start_index > 0 ? x_start_index - 1 : x_size - 1;
+  }
+}
+
+template <size_t kSubBlockSize, size_t kFilterLength, size_t kFilterShift>
+void MatchedFilterBankCore(size_t x_start_index,
+                           size_t filter_shift,
+                           float x2_sum_threshold,
+                           float smoothing,
+                           rtc::ArrayView<const float> x,
+                           rtc::ArrayView<const float> y,
+                           rtc::ArrayView<float> h,
+                           rtc::ArrayView<bool> filters_updated,
+                           rtc::ArrayView<float> error_sums,
+                           rtc::ArrayView<float> x2_sums) {
+  const size_t num_filters = error_sums.size();
+  // The sizes that are known at compile time replace the given ones.
+  const size_t sub_block_size = kSubBlockSize > 0 ? kSubBlockSize : y.size();
+  const size_t h_size =
+      kFilterLength > 0 ? kFilterLength : h.size() / num_filters;
+  const size_t shift = kFilterShift > 0 ? kFilterShift : filter_shift;
+  // The number of samples that each filter shares with the next one.
+  const size_t overlap = h_size > shift ? h_size - shift : 0;
+  // The size of the circular buffer that x mirrors.
+  const size_t x_size = x.size() / 2;
+  RTC_DCHECK_LE(2 * overlap, h_size);
+  RTC_DCHECK_GE(x_size, (num_filters - 1) * shift + h_size);
+  RTC_DCHECK_EQ(sub_block_size, y.size());
+  RTC_DCHECK_EQ(num_filters * h_size, h.size());
+  RTC_DCHECK_EQ(shift, filter_shift);
+  RTC_DCHECK_EQ(num_filters, filters_updated.size());
+  RTC_DCHECK_EQ(num_filters, error_sums.size());
+  RTC_DCHECK_EQ(num_filters, x2_sums.size());
+
+  // Apply the filters in groups that fit in the L1 cache, so that every group
+  // can be applied to the whole sub-block. Only the filters within a group
+  // share their overlaps.
+  const size_t group_size =
+      std::max<size_t>(1, kMatchedFilterBankGroupSamples / h_size);
+  for (size_t first = 0; first < num_filters; first += group_size) {
+    const size_t last = std::min(num_filters, first + group_size);
+
+    // Compute x * x for the first sample in the sub-block, computing the
+    // overlap of adjacent filters once.
+    float x2_sum = 0.f;
+    for (size_t n = first; n < last; ++n) {
+      const float* x_p = &x[x_start_index + n * shift];
+      const size_t begin = n > first ? overlap : 0;
+      const size_t end = n + 1 < last ? h_size - overlap : h_size;
+      for (size_t k = begin; k < end; ++k) {
+        x2_sum += x_p[k] * x_p[k];
+      }
+
+      float next_x2_sum = 0.f;
+      for (size_t k = end; k < h_size; ++k) {
+        next_x2_sum += x_p[k] * x_p[k];
+      }
+      x2_sums[n] = x2_sum + next_x2_sum;
+      x2_sum = next_x2_sum;
+    }
+
+    // Process for all samples in the sub-block.
+    size_t x_index = x_start_index;
+    for (size_t i = 0; i < sub_block_size; ++i) {
+      RTC_DCHECK_GT(x_size, x_index);
+      const bool saturation = y[i] >= 32000.f || y[i] <= -32000.f;
+
+      // The accumulated value of the current filter, which may already hold
+      // the overlap with the previous filter.
+      float s = 0.f;
+      for (size_t n = first; n < last; ++n) {
+        const float* x_p = &x[x_index + n * shift];
+        float* h_p = &h[n * h_size];
+
+        // Apply the matched filter as filter * x for the samples that are not
+        // shared with the previous or the next filter.
+        const size_t begin = n > first ? overlap : 0;
+        const size_t end = n + 1 < last ? h_size - overlap : h_size;
+        for (size_t k = begin; k < end; ++k) {
+          s += h_p[k] * x_p[k];
+        }
+
+        // Apply both this and the next filter to the samples they share.
+        float next_s = 0.f;
+        if (n + 1 < last) {
+          const float* next_h_p = &h[(n + 1) * h_size];
+          for (size_t k = end; k < h_size; ++k) {
+            s += h_p[k] * x_p[k];
+            next_s += next_h_p[k - end] * x_p[k];
+          }
+        }
+
+        // Compute the matched filter error.
+        float e = y[i] - s;
+        error_sums[n] += e * e;
+
+        // Update the matched filter estimate in an NLMS manner.
+        const float x2_sum = x2_sums[n];
+        if (x2_sum > x2_sum_threshold && !saturation) {
+          RTC_DCHECK_LT(0.f, x2_sum);
+          const float alpha = smoothing * e / x2_sum;
+
+          // filter = filter + smoothing * (y - filter * x) * x / x * x.
+          for (size_t k = 0; k < h_size; ++k) {
+            h_p[k] += alpha * x_p[k];
+          }
+          filters_updated[n] = true;
+        }
+
+        s = next_s;
+      }
+
+      // Slide x * x of every filter one sample back.
+      const size_t next_x_index = x_index > 0 ? x_index - 1 : x_size - 1;
+      for (size_t n = first; n < last; ++n) {
+        const float x_in = x[next_x_index + n * shift];
+        const float x_out = x[x_index + n * shift + h_size - 1];
+        x2_sums[n] += x_in * x_in - x_out * x_out;
+      }
+      x_index = next_x_index;
+    }
+  }
+}
+
+#define INSTANTIATE_MATCHED_FILTER_BANK_CORE(sub_block_size, filter_length,   \
+                                             filter_shift)                    \
+  template void                                                               \
+  MatchedFilterBankCore<sub_block_size, filter_length, filter_shift>(         \
+      size_t, size_t, float, float, rtc::ArrayView<const float>,              \
+      rtc::ArrayView<const float>, rtc::ArrayView<float>,                     \
+      rtc::ArrayView<bool>, rtc::ArrayView<float>, rtc::ArrayView<float>);
+MATCHED_FILTER_BANK_SPECIALIZATIONS(INSTANTIATE_MATCHED_FILTER_BANK_CORE)
+#undef INSTANTIATE_MATCHED_FILTER_BANK_CORE
+
+size_t MaxSquarePeakIndex(rtc::ArrayView<const float> h) {
+  RTC_DCHECK_LT(0, h.size());
+  float peak = h[0] * h[0];
+  size_t peak_index = 0;
+  for (size_t k = 1; k < h.size(); ++k) {
+    const float square = h[k] * h[k];
+    if (square > peak) {
+      peak = square;
+      peak_index = k;
+    }
+  }
+  return peak_index;
+}
+
+namespace {
+
+// Returns the filter bank core for |optimization| with the given
+// specialization.
+template <size_t kSubBlockSize, size_t kFilterLength, size_t kFilterShift>
+MatchedFilterBankCoreFunction SelectMatchedFilterBankCore(
+    Aec3Optimization optimization) {
+  switch (optimization) {
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+    case Aec3Optimization::kSse2:
+      return &MatchedFilterBankCore_SSE2<kSubBlockSize, kFilterLength,
+                                         kFilterShift>;
+    case Aec3Optimization::kAvx2:
+      return &MatchedFilterBankCore_AVX2<kSubBlockSize, kFilterLength,
+                                         kFilterShift>;
+    case Aec3Optimization::kAvx512:
+      return &MatchedFilterBankCore_AVX512<kSubBlockSize, kFilterLength,
+                                           kFilterShift>;
+#endif
+#if defined(WEBRTC_HAS_NEON)
+    case Aec3Optimization::kNeon:
+      return &MatchedFilterBankCore_NEON<kSubBlockSize, kFilterLength,
+                                         kFilterShift>;
+#endif
+    default:
+      return &MatchedFilterBankCore<kSubBlockSize, kFilterLength,
+                                    kFilterShift>;
+  }
+}
+
+}  // namespace
+
+MatchedFilterBankCoreFunction SelectMatchedFilterBankCore(
+    Aec3Optimization optimization,
+    size_t sub_block_size,
+    size_t filter_length,
+    size_t filter_shift) {
+#define SELECT_MATCHED_FILTER_BANK_CORE(specialized_sub_block_size,         \
+                                        specialized_filter_length,          \
+                                        specialized_filter_shift)           \
+  if (sub_block_size == specialized_sub_block_size &&                       \
+      filter_length == specialized_filter_length &&                         \
+      filter_shift == specialized_filter_shift) {                           \
+    return SelectMatchedFilterBankCore<specialized_sub_block_size,          \
+                                       specialized_filter_length,           \
+                                       specialized_filter_shift>(           \
+        optimization);                                                      \
+  }
+  MATCHED_FILTER_BANK_SPECIALIZATIONS(SELECT_MATCHED_FILTER_BANK_CORE)
+#undef SELECT_MATCHED_FILTER_BANK_CORE
+
+  return SelectMatchedFilterBankCore<0, 0, 0>(optimization);
+}
+
+MaxSquarePeakIndexFunction SelectMaxSquarePeakIndex(
+    Aec3Optimization optimization) {
+  switch (optimization) {
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+    case Aec3Optimization::kSse2:
+      return &MaxSquarePeakIndex_SSE2;
+    case Aec3Optimization::kAvx2:
+    case Aec3Optimization::kAvx512:
+      return &MaxSquarePeakIndex_AVX2;
+#endif
+#if defined(WEBRTC_HAS_NEON)
+    case Aec3Optimization::kNeon:
+      return &MaxSquarePeakIndex_NEON;
+#endif
+    default:
+      return &MaxSquarePeakIndex;
   }
 }
 
@@ -308,16 +873,29 @@ MatchedFilter::MatchedFilter(ApmDataDumper* data_dumper,
                              size_t alignment_shift_sub_blocks,
                              float excitation_limit,
                              float smoothing,
-                             float matching_filter_threshold)
+                             float matching_filter_threshold,
+                             size_t num_threads)
     : data_dumper_(data_dumper),
-      optimization_(optimization),
       sub_block_size_(sub_block_size),
       filter_intra_lag_shift_(alignment_shift_sub_blocks * sub_block_size_),
-      filters_(
-          num_matched_filters,
-          std::vector<float>(window_size_sub_blocks * sub_block_size_, 0.f)),
+      filter_arena_(AlignedMalloc<float>(
+          num_matched_filters * window_size_sub_blocks * sub_block_size_ *
+              sizeof(float),
+          aec3::kMatchedFilterAlignment)),
+      filter_coefficients_(
+          filter_arena_.get(),
+          num_matched_filters * window_size_sub_blocks * sub_block_size_),
       lag_estimates_(num_matched_filters),
       filters_offsets_(num_matched_filters, 0),
+      error_sums_(num_matched_filters, 0.f),
+      x2_sums_(num_matched_filters, 0.f),
+      bank_core_(aec3::SelectMatchedFilterBankCore(
+          optimization,
+          sub_block_size,
+          window_size_sub_blocks * sub_block_size,
+          alignment_shift_sub_blocks * sub_block_size)),
+      max_square_peak_index_(aec3::SelectMaxSquarePeakIndex(optimization)),
+      filters_updated_(new bool[num_matched_filters]),
       excitation_limit_(excitation_limit),
       smoothing_(smoothing),
       matching_filter_threshold_(matching_filter_threshold) {
@@ -325,130 +903,192 @@ MatchedFilter::MatchedFilter(ApmDataDumper* data_dumper,
   RTC_DCHECK_LT(0, window_size_sub_blocks);
   RTC_DCHECK((kBlockSize % sub_block_size) == 0);
   RTC_DCHECK((sub_block_size % 4) == 0);
+  // The filter bank cores only share samples between adjacent filters.
+  RTC_DCHECK_LE(window_size_sub_blocks, 2 * alignment_shift_sub_blocks);
+  const size_t filter_length = window_size_sub_blocks * sub_block_size_;
+  for (int n = 0; n < num_matched_filters; ++n) {
+    filters_.emplace_back(&filter_coefficients_[n * filter_length],
+                          filter_length);
+  }
+  for (size_t n = 0; n < filters_offsets_.size(); ++n) {
+    filters_offsets_[n] = n * filter_intra_lag_shift_;
+  }
+  Reset();
+
+  RTC_DCHECK_LT(0, num_threads);
+  num_threads = std::min(num_threads, filters_.size());
+  if (num_threads > 1) {
+    thread_pool_.reset(new PartitionedThreadPool(
+        num_threads, filters_.size(), [this](size_t first, size_t last) {
+          first = std::max(first, first_updated_filter_);
+          last = std::min(last, last_updated_filter_);
+          if (first < last) {
+            UpdateFilters(first, last);
+          }
+        }));
+  }
 }
 
 MatchedFilter::~MatchedFilter() = default;
 
 void MatchedFilter::Reset() {
-  for (auto& f : filters_) {
-    std::fill(f.begin(), f.end(), 0.f);
-  }
+  std::memset(filter_coefficients_.data(), 0,
+              filter_coefficients_.size() * sizeof(float));
 
   for (auto& l : lag_estimates_) {
     l = MatchedFilter::LagEstimate();
   }
 }
 
+void MatchedFilter::SetFilterOffset(size_t offset) {
+  if (filters_offsets_[0] == offset) {
+    return;
+  }
+
+  for (size_t n = 0; n < filters_offsets_.size(); ++n) {
+    filters_offsets_[n] = offset + n * filter_intra_lag_shift_;
+  }
+  Reset();
+}
+
 void MatchedFilter::Update(const DownsampledRenderBuffer& render_buffer,
                            rtc::ArrayView<const float> capture) {
-  RTC_DCHECK_EQ(sub_block_size_, capture.size());
-  auto& y = capture;
+  Update(render_buffer, capture, 0, filters_.size());
+}
 
-  const float x2_sum_threshold =
-      filters_[0].size() * excitation_limit_ * excitation_limit_;
+void MatchedFilter::Update(const DownsampledRenderBuffer& render_buffer,
+                           rtc::ArrayView<const float> capture,
+                           size_t first_filter,
+                           size_t last_filter) {
+  RTC_DCHECK_EQ(sub_block_size_, capture.size());
+  RTC_DCHECK_LT(first_filter, last_filter);
+  RTC_DCHECK_LE(last_filter, filters_.size());
+
+  render_buffer_ = &render_buffer;
+  capture_ = capture;
+  first_updated_filter_ = first_filter;
+  last_updated_filter_ = last_filter;
+
+  // Compute anchor for the matched filter error.
+  error_sum_anchor_ =
+      std::inner_product(capture.begin(), capture.end(), capture.begin(), 0.f);
+
+  // Apply the selected matched filters.
+  if (thread_pool_ &&
+      last_filter - first_filter > thread_pool_->max_part_size()) {
+    thread_pool_->Run();
+  } else {
+    UpdateFilters(first_filter, last_filter);
+  }
 
-  // Apply all matched filters.
-  size_t alignment_shift = 0;
+  // The filters that were not applied keep their lag estimates, which are only
+  // marked as not updated.
   for (size_t n = 0; n < filters_.size(); ++n) {
-    float error_sum = 0.f;
-    bool filters_updated = false;
-
-    size_t x_start_index =
-        (render_buffer.read + alignment_shift + sub_block_size_ - 1) %
-        render_buffer.buffer.size();
+    if (n < first_filter || n >= last_filter) {
+      lag_estimates_[n].updated = false;
+      continue;
+    }
 
-    switch (optimization_) {
-#if defined(WEBRTC_ARCH_X86_FAMILY)
-      case Aec3Optimization::kSse2:
-        aec3::MatchedFilterCore_SSE2(x_start_index, x2_sum_threshold,
-                                     smoothing_, render_buffer.buffer, y,
-                                     filters_[n], &filters_updated, &error_sum);
-        break;
-      case Aec3Optimization::kAvx2:
-        aec3::MatchedFilterCore_AVX2(x_start_index, x2_sum_threshold,
-                                     smoothing_, render_buffer.buffer, y,
-                                     filters_[n], &filters_updated, &error_sum);
-        break;
+#if WEBRTC_APM_DEBUG_DUMP == 1
+    const std::string filter_name =
+        "aec3_correlator_" + std::to_string(n) + "_h";
+    data_dumper_->DumpRaw(filter_name.c_str(), filters_[n]);
 #endif
-#if defined(WEBRTC_HAS_NEON)
-      case Aec3Optimization::kNeon:
-        aec3::MatchedFilterCore_NEON(x_start_index, x2_sum_threshold,
-                                     smoothing_, render_buffer.buffer, y,
-                                     filters_[n], &filters_updated, &error_sum);
-        break;
-#endif
-      default:
-        aec3::MatchedFilterCore(x_start_index, x2_sum_threshold, smoothing_,
-                                render_buffer.buffer, y, filters_[n],
-                                &filters_updated, &error_sum);
-    }
+  }
+}
+
+void MatchedFilter::UpdateFilters(size_t first_filter, size_t last_filter) {
+  auto& y = capture_;
+
+  const float x2_sum_threshold =
+      filters_[0].size() * excitation_limit_ * excitation_limit_;
 
-    // Compute anchor for the matched filter error.
-    const float error_sum_anchor =
-        std::inner_product(y.begin(), y.end(), y.begin(), 0.f);
+  // Only the entries of the applied filters are written, so that the threads
+  // of |thread_pool_| never write to the same entries.
+  const size_t num_filters = last_filter - first_filter;
+  const size_t filter_length = filters_[0].size();
+  rtc::ArrayView<float> error_sums =
+      rtc::ArrayView<float>(error_sums_).subview(first_filter, num_filters);
+  rtc::ArrayView<bool> filters_updated =
+      rtc::ArrayView<bool>(filters_updated_.get(), filters_.size())
+          .subview(first_filter, num_filters);
+  std::fill(error_sums.begin(), error_sums.end(), 0.f);
+  std::fill(filters_updated.begin(), filters_updated.end(), false);
+  const size_t x_start_index = (render_buffer_->read +
+                                filters_offsets_[first_filter] +
+                                sub_block_size_ - 1) %
+                               render_buffer_->size;
+
+  bank_core_(x_start_index, filter_intra_lag_shift_, x2_sum_threshold,
+             smoothing_, render_buffer_->buffer, y,
+             filter_coefficients_.subview(first_filter * filter_length,
+                                          num_filters * filter_length),
+             filters_updated, error_sums,
+             rtc::ArrayView<float>(x2_sums_).subview(first_filter,
+                                                     num_filters));
+
+  // A weaker echo path only explains part of the energy left by the stronger
+  // ones, so it rarely passes matching_filter_threshold_. A filter that has
+  // not found an echo path may still explain part of a sub-block by chance,
+  // but its energy is then spread over the whole filter instead of being
+  // gathered around the peak.
+  constexpr float kMinCandidateExplainedEnergy = 0.1f;
+  constexpr float kMinCandidatePeakEnergyFraction = 0.1f;
+
+  for (size_t n = first_filter; n < last_filter; ++n) {
+    const size_t alignment_shift = filters_offsets_[n];
+    const float error_sum = error_sums_[n];
 
     // Estimate the lag in the matched filter as the distance to the portion in
     // the filter that contributes the most to the matched filter output. This
     // is detected as the peak of the matched filter.
-    const size_t lag_estimate = std::distance(
-        filters_[n].begin(),
-        std::max_element(
-            filters_[n].begin(), filters_[n].end(),
-            [](float a, float b) -> bool { return a * a < b * b; }));
+    const size_t lag_estimate = max_square_peak_index_(filters_[n]);
+    const bool peak_inside_filter =
+        lag_estimate > 2 && lag_estimate < (filters_[n].size() - 10);
 
     // Update the lag estimates for the matched filter.
-    lag_estimates_[n] = LagEstimate(
-        error_sum_anchor - error_sum,
-        (lag_estimate > 2 && lag_estimate < (filters_[n].size() - 10) &&
-         error_sum < matching_filter_threshold_ * error_sum_anchor),
-        lag_estimate + alignment_shift, filters_updated);
-
-    RTC_DCHECK_GE(10, filters_.size());
-    switch (n) {
-      case 0:
-        data_dumper_->DumpRaw("aec3_correlator_0_h", filters_[0]);
-        break;
-      case 1:
-        data_dumper_->DumpRaw("aec3_correlator_1_h", filters_[1]);
-        break;
-      case 2:
-        data_dumper_->DumpRaw("aec3_correlator_2_h", filters_[2]);
-        break;
-      case 3:
-        data_dumper_->DumpRaw("aec3_correlator_3_h", filters_[3]);
-        break;
-      case 4:
-        data_dumper_->DumpRaw("aec3_correlator_4_h", filters_[4]);
-        break;
-      case 5:
-        data_dumper_->DumpRaw("aec3_correlator_5_h", filters_[5]);
-        break;
-      case 6:
-        data_dumper_->DumpRaw("aec3_correlator_6_h", filters_[6]);
-        break;
-      case 7:
-        data_dumper_->DumpRaw("aec3_correlator_7_h", filters_[7]);
-        break;
-      case 8:
-        data_dumper_->DumpRaw("aec3_correlator_8_h", filters_[8]);
-        break;
-      case 9:
-        data_dumper_->DumpRaw("aec3_correlator_9_h", filters_[9]);
-        break;
-      default:
-        RTC_NOTREACHED();
+    LagEstimate& estimate = lag_estimates_[n];
+    estimate = LagEstimate(
+        error_sum_anchor_ - error_sum,
+        (peak_inside_filter &&
+         error_sum < matching_filter_threshold_ * error_sum_anchor_),
+        lag_estimate + alignment_shift, filters_updated_[n]);
+    estimate.explained_energy =
+        error_sum_anchor_ > 0.f ? 1.f - error_sum / error_sum_anchor_ : 0.f;
+    if (peak_inside_filter &&
+        estimate.explained_energy >= kMinCandidateExplainedEnergy) {
+      const float peak = filters_[n][lag_estimate];
+      const float filter_energy = std::inner_product(
+          filters_[n].begin(), filters_[n].end(), filters_[n].begin(), 0.f);
+      estimate.candidate =
+          peak * peak >= kMinCandidatePeakEnergyFraction * filter_energy;
     }
+  }
+}
 
-    alignment_shift += filter_intra_lag_shift_;
+std::pair<size_t, size_t> MatchedFilter::GetFiltersCoveringLag(
+    size_t lag) const {
+  size_t first_filter = filters_.size();
+  size_t last_filter = 0;
+  for (size_t n = 0; n < filters_.size(); ++n) {
+    if (lag >= filters_offsets_[n] &&
+        lag < filters_offsets_[n] + filters_[n].size()) {
+      first_filter = std::min(first_filter, n);
+      last_filter = n + 1;
+    }
+  }
+  if (first_filter >= last_filter) {
+    return std::make_pair(size_t{0}, size_t{0});
   }
+  return std::make_pair(first_filter, last_filter);
 }
 
 void MatchedFilter::LogFilterProperties(int sample_rate_hz,
                                         size_t shift,
                                         size_t downsampling_factor) const {
-  size_t alignment_shift = 0;
   constexpr int kFsBy1000 = 16;
   for (size_t k = 0; k < filters_.size(); ++k) {
+    const size_t alignment_shift = filters_offsets_[k];
     int start = static_cast<int>(alignment_shift * downsampling_factor);
     int end = static_cast<int>((alignment_shift + filters_[k].size()) *
                                downsampling_factor);
@@ -457,7 +1097,6 @@ void MatchedFilter::LogFilterProperties(int sample_rate_hz,
                         << " ms, end: "
                         << (end - static_cast<int>(shift)) / kFsBy1000
                         << " ms.";
-    alignment_shift += filter_intra_lag_shift_;
   }
 }
 
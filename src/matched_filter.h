@@ -13,9 +13,12 @@
 
 #include <stddef.h>
 
+#include <memory>
+#include <utility>
 #include <vector>
 
 #include "aec3_common.h"
+#include "aligned_malloc.h"
 #include "arch.h"
 #include "array_view.h"
 
@@ -23,9 +26,48 @@ namespace webrtc {
 
 class ApmDataDumper;
 struct DownsampledRenderBuffer;
+class PartitionedThreadPool;
 
 namespace aec3 {
 
+// The filter cores read |x| as a circular buffer of x.size() / 2 samples that
+// is followed by a copy of itself, which is how DownsampledRenderBuffer stores
+// the render signal. This keeps every filter window contiguous in memory.
+//
+// The filter bank cores update all the filters in |h| at once. |h| holds the
+// filters back to back and must be aligned to kMatchedFilterAlignment bytes,
+// so that the cores can use aligned loads and stores for all the filter
+// coefficients. Filter n starts |filter_shift| * n samples after
+// x_start_index, and adjacent filters may overlap by at most half a filter.
+// The samples in an overlap are loaded once for both filters. x * x is
+// computed over the whole window once per sub-block, which bounds the rounding
+// drift, and is then updated with the sample entering and the sample leaving
+// the window. |x2_sums| holds these sums and must have one element per filter.
+
+// The filter bank cores are templates that can be specialized for a sub-block
+// size, filter length and filter shift that are known at compile time, which
+// gives all their loops constant trip counts. A template argument of zero
+// takes the size from the function arguments instead.
+//
+// The specializations that are compiled: the first search stage at down
+// sampling factors 2, 4 and 8, the second search stage at down sampling
+// factors 2 and 4, and the one that takes all the sizes at run time.
+#define MATCHED_FILTER_BANK_SPECIALIZATIONS(X) \
+  X(32, 1024, 768)                             \
+  X(16, 512, 384)                              \
+  X(8, 256, 192)                               \
+  X(32, 256, 192)                              \
+  X(16, 128, 96)                               \
+  X(0, 0, 0)
+
+// Alignment in bytes of the filter coefficients for the filter bank cores,
+// which is the width of the widest vectors that they use.
+constexpr size_t kMatchedFilterAlignment = 64;
+
+// Number of filter coefficients that the filter bank cores apply together.
+// 4096 coefficients take up 16 kB, which leaves room for x in the L1 cache.
+constexpr size_t kMatchedFilterBankGroupSamples = 4096;
+
 #if defined(WEBRTC_HAS_NEON)
 
 // Filter core for the matched filter that is optimized for NEON.
@@ -38,6 +80,25 @@ void MatchedFilterCore_NEON(size_t x_start_index,
                             bool* filters_updated,
                             float* error_sum);
 
+// Filter bank core for the matched filter that is optimized for NEON.
+template <size_t kSubBlockSize = 0,
+          size_t kFilterLength = 0,
+          size_t kFilterShift = 0>
+void MatchedFilterBankCore_NEON(size_t x_start_index,
+                                size_t filter_shift,
+                                float x2_sum_threshold,
+                                float smoothing,
+                                rtc::ArrayView<const float> x,
+                                rtc::ArrayView<const float> y,
+                                rtc::ArrayView<float> h,
+                                rtc::ArrayView<bool> filters_updated,
+                                rtc::ArrayView<float> error_sums,
+                                rtc::ArrayView<float> x2_sums);
+
+// Returns the index of the element in |h| with the largest square, optimized
+// for NEON.
+size_t MaxSquarePeakIndex_NEON(rtc::ArrayView<const float> h);
+
 #endif
 
 #if defined(WEBRTC_ARCH_X86_FAMILY)
@@ -52,6 +113,25 @@ void MatchedFilterCore_SSE2(size_t x_start_index,
                             bool* filters_updated,
                             float* error_sum);
 
+// Filter bank core for the matched filter that is optimized for SSE2.
+template <size_t kSubBlockSize = 0,
+          size_t kFilterLength = 0,
+          size_t kFilterShift = 0>
+void MatchedFilterBankCore_SSE2(size_t x_start_index,
+                                size_t filter_shift,
+                                float x2_sum_threshold,
+                                float smoothing,
+                                rtc::ArrayView<const float> x,
+                                rtc::ArrayView<const float> y,
+                                rtc::ArrayView<float> h,
+                                rtc::ArrayView<bool> filters_updated,
+                                rtc::ArrayView<float> error_sums,
+                                rtc::ArrayView<float> x2_sums);
+
+// Returns the index of the element in |h| with the largest square, optimized
+// for SSE2.
+size_t MaxSquarePeakIndex_SSE2(rtc::ArrayView<const float> h);
+
 // Filter core for the matched filter that is optimized for AVX2.
 void MatchedFilterCore_AVX2(size_t x_start_index,
                             float x2_sum_threshold,
@@ -62,6 +142,50 @@ void MatchedFilterCore_AVX2(size_t x_start_index,
                             bool* filters_updated,
                             float* error_sum);
 
+// Filter bank core for the matched filter that is optimized for AVX2.
+template <size_t kSubBlockSize = 0,
+          size_t kFilterLength = 0,
+          size_t kFilterShift = 0>
+void MatchedFilterBankCore_AVX2(size_t x_start_index,
+                                size_t filter_shift,
+                                float x2_sum_threshold,
+                                float smoothing,
+                                rtc::ArrayView<const float> x,
+                                rtc::ArrayView<const float> y,
+                                rtc::ArrayView<float> h,
+                                rtc::ArrayView<bool> filters_updated,
+                                rtc::ArrayView<float> error_sums,
+                                rtc::ArrayView<float> x2_sums);
+
+// Returns the index of the element in |h| with the largest square, optimized
+// for AVX2.
+size_t MaxSquarePeakIndex_AVX2(rtc::ArrayView<const float> h);
+
+// Filter core for the matched filter that is optimized for AVX-512.
+void MatchedFilterCore_AVX512(size_t x_start_index,
+                              float x2_sum_threshold,
+                              float smoothing,
+                              rtc::ArrayView<const float> x,
+                              rtc::ArrayView<const float> y,
+                              rtc::ArrayView<float> h,
+                              bool* filters_updated,
+                              float* error_sum);
+
+// Filter bank core for the matched filter that is optimized for AVX-512.
+template <size_t kSubBlockSize = 0,
+          size_t kFilterLength = 0,
+          size_t kFilterShift = 0>
+void MatchedFilterBankCore_AVX512(size_t x_start_index,
+                                  size_t filter_shift,
+                                  float x2_sum_threshold,
+                                  float smoothing,
+                                  rtc::ArrayView<const float> x,
+                                  rtc::ArrayView<const float> y,
+                                  rtc::ArrayView<float> h,
+                                  rtc::ArrayView<bool> filters_updated,
+                                  rtc::ArrayView<float> error_sums,
+                                  rtc::ArrayView<float> x2_sums);
+
 #endif
 
 // Filter core for the matched filter.
@@ -74,6 +198,54 @@ void MatchedFilterCore(size_t x_start_index,
                        bool* filters_updated,
                        float* error_sum);
 
+// Filter bank core for the matched filter.
+template <size_t kSubBlockSize = 0,
+          size_t kFilterLength = 0,
+          size_t kFilterShift = 0>
+void MatchedFilterBankCore(size_t x_start_index,
+                           size_t filter_shift,
+                           float x2_sum_threshold,
+                           float smoothing,
+                           rtc::ArrayView<const float> x,
+                           rtc::ArrayView<const float> y,
+                           rtc::ArrayView<float> h,
+                           rtc::ArrayView<bool> filters_updated,
+                           rtc::ArrayView<float> error_sums,
+                           rtc::ArrayView<float> x2_sums);
+
+// Returns the index of the element in |h| with the largest square, which is
+// the first one if several elements share it.
+size_t MaxSquarePeakIndex(rtc::ArrayView<const float> h);
+
+// Pointer to a peak search function.
+using MaxSquarePeakIndexFunction = size_t (*)(rtc::ArrayView<const float> h);
+
+// Returns the peak search function for |optimization|.
+MaxSquarePeakIndexFunction SelectMaxSquarePeakIndex(
+    Aec3Optimization optimization);
+
+// Pointer to a filter bank core.
+using MatchedFilterBankCoreFunction =
+    void (*)(size_t x_start_index,
+             size_t filter_shift,
+             float x2_sum_threshold,
+             float smoothing,
+             rtc::ArrayView<const float> x,
+             rtc::ArrayView<const float> y,
+             rtc::ArrayView<float> h,
+             rtc::ArrayView<bool> filters_updated,
+             rtc::ArrayView<float> error_sums,
+             rtc::ArrayView<float> x2_sums);
+
+// Returns the filter bank core for |optimization| that is specialized for the
+// sub-block size, filter length and filter shift, or the one that takes them at
+// run time if there is no such specialization.
+MatchedFilterBankCoreFunction SelectMatchedFilterBankCore(
+    Aec3Optimization optimization,
+    size_t sub_block_size,
+    size_t filter_length,
+    size_t filter_shift);
+
 }  // namespace aec3
 
 // Produces recursively updated cross-correlation estimates for several signal
@@ -91,6 +263,12 @@ class MatchedFilter {
     bool reliable = false;
     size_t lag = 0;
     bool updated = false;
+    // Fraction of the capture energy that the filter explains.
+    float explained_energy = 0.f;
+    // Whether the lag may stand for an echo path besides the strongest one,
+    // which only needs the filter to explain a smaller part of the energy and
+    // to gather its own energy around the peak.
+    bool candidate = false;
   };
 
   MatchedFilter(ApmDataDumper* data_dumper,
@@ -101,7 +279,8 @@ class MatchedFilter {
                 size_t alignment_shift_sub_blocks,
                 float excitation_limit,
                 float smoothing,
-                float matching_filter_threshold);
+                float matching_filter_threshold,
+                size_t num_threads);
 
   MatchedFilter() = delete;
   MatchedFilter(const MatchedFilter&) = delete;
@@ -109,13 +288,41 @@ class MatchedFilter {
 
   ~MatchedFilter();
 
-  // Updates the correlation with the values in the capture buffer.
+  // Updates the correlation with the values in the capture buffer. With more
+  // than one thread, the filters are split between the threads, unless the
+  // filters to update fit in the part of one thread.
   void Update(const DownsampledRenderBuffer& render_buffer,
               rtc::ArrayView<const float> capture);
 
+  // Updates the correlation of the filters from |first_filter| up to, but not
+  // including, |last_filter|. The other filters keep their lag estimates, which
+  // are marked as not updated.
+  void Update(const DownsampledRenderBuffer& render_buffer,
+              rtc::ArrayView<const float> capture,
+              size_t first_filter,
+              size_t last_filter);
+
   // Resets the matched filter.
   void Reset();
 
+  // Moves the filters so that the first one starts at a lag of |offset|,
+  // keeping the uniform intra-filter spacing. The filters are reset if they
+  // are moved.
+  void SetFilterOffset(size_t offset);
+
+  // Returns the lag at which the first filter starts.
+  size_t GetFilterOffset() const { return filters_offsets_[0]; }
+
+  // Returns the range of lags that the filters cover together.
+  size_t GetFilterCoverage() const {
+    return (filters_.size() - 1) * filter_intra_lag_shift_ +
+           filters_[0].size();
+  }
+
+  // Returns the first filter that covers |lag| and the one after the last
+  // filter that covers it, which are equal if no filter covers |lag|.
+  std::pair<size_t, size_t> GetFiltersCoveringLag(size_t lag) const;
+
   // Returns the current lag estimates.
   rtc::ArrayView<const MatchedFilter::LagEstimate> GetLagEstimates() const {
     return lag_estimates_;
@@ -132,16 +339,36 @@ class MatchedFilter {
                            size_t downsampling_factor) const;
 
  private:
+  // Applies the filters from |first_filter| up to, but not including,
+  // |last_filter| to the current block, and estimates their lags.
+  void UpdateFilters(size_t first_filter, size_t last_filter);
+
   ApmDataDumper* const data_dumper_;
-  const Aec3Optimization optimization_;
   const size_t sub_block_size_;
   const size_t filter_intra_lag_shift_;
-  std::vector<std::vector<float>> filters_;
+  // The coefficients of all the filters, stored back to back.
+  const std::unique_ptr<float[], AlignedFreeDeleter> filter_arena_;
+  const rtc::ArrayView<float> filter_coefficients_;
+  std::vector<rtc::ArrayView<float>> filters_;
   std::vector<LagEstimate> lag_estimates_;
   std::vector<size_t> filters_offsets_;
+  std::vector<float> error_sums_;
+  std::vector<float> x2_sums_;
+  const aec3::MatchedFilterBankCoreFunction bank_core_;
+  const aec3::MaxSquarePeakIndexFunction max_square_peak_index_;
+  std::unique_ptr<bool[]> filters_updated_;
   const float excitation_limit_;
   const float smoothing_;
   const float matching_filter_threshold_;
+
+  // The block that the filters are updated with, which is only read by the
+  // threads of |thread_pool_|.
+  const DownsampledRenderBuffer* render_buffer_ = nullptr;
+  rtc::ArrayView<const float> capture_;
+  float error_sum_anchor_ = 0.f;
+  size_t first_updated_filter_ = 0;
+  size_t last_updated_filter_ = 0;
+  std::unique_ptr<PartitionedThreadPool> thread_pool_;
 };
 
 }  // namespace webrtc
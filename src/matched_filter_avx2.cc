@@ -12,6 +12,9 @@
 
 #include <immintrin.h>
 
+#include <algorithm>
+#include <cstdint>
+
 #include "checks.h"
 
 namespace webrtc {
@@ -26,8 +29,10 @@ void MatchedFilterCore_AVX2(size_t x_start_index,
                             bool* filters_updated,
                             float* error_sum) {
   const int h_size = static_cast<int>(h.size());
-  const int x_size = static_cast<int>(x.size());
+  // The size of the circular buffer that x mirrors.
+  const size_t x_size = x.size() / 2;
   RTC_DCHECK_EQ(0, h_size % 8);
+  RTC_DCHECK_GE(x_size, h.size());
 
   // Process for all samples in the sub-block.
   for (size_t i = 0; i < y.size(); ++i) {
@@ -40,36 +45,15 @@ void MatchedFilterCore_AVX2(size_t x_start_index,
     // Initialize values for the accumulation.
     __m256 s_256 = _mm256_set1_ps(0);
     __m256 x2_sum_256 = _mm256_set1_ps(0);
-    float x2_sum = 0.f;
-    float s = 0;
-
-    // Compute loop chunk sizes until, and after, the wraparound of the circular
-    // buffer for x.
-    const int chunk1 =
-        std::min(h_size, static_cast<int>(x_size - x_start_index));
-
-    // Perform the loop in two chunks.
-    const int chunk2 = h_size - chunk1;
-    for (int limit : {chunk1, chunk2}) {
-      // Perform 256 bit vector operations.
-      const int limit_by_8 = limit >> 3;
-      for (int k = limit_by_8; k > 0; --k, h_p += 8, x_p += 8) {
-        // Load the data into 256 bit vectors.
-        __m256 x_k = _mm256_loadu_ps(x_p);
-        __m256 h_k = _mm256_loadu_ps(h_p);
-        // Compute and accumulate x * x and h * x.
-        x2_sum_256 = _mm256_fmadd_ps(x_k, x_k, x2_sum_256);
-        s_256 = _mm256_fmadd_ps(h_k, x_k, s_256);
-      }
-
-      // Perform non-vector operations for any remaining items.
-      for (int k = limit - limit_by_8 * 8; k > 0; --k, ++h_p, ++x_p) {
-        const float x_k = *x_p;
-        x2_sum += x_k * x_k;
-        s += *h_p * x_k;
-      }
 
-      x_p = &x[0];
+    // Perform 256 bit vector operations.
+    for (int k = h_size >> 3; k > 0; --k, h_p += 8, x_p += 8) {
+      // Load the data into 256 bit vectors.
+      __m256 x_k = _mm256_loadu_ps(x_p);
+      __m256 h_k = _mm256_loadu_ps(h_p);
+      // Compute and accumulate x * x and h * x.
+      x2_sum_256 = _mm256_fmadd_ps(x_k, x_k, x2_sum_256);
+      s_256 = _mm256_fmadd_ps(h_k, x_k, s_256);
     }
 
     // Sum components together.
@@ -77,11 +61,11 @@ void MatchedFilterCore_AVX2(size_t x_start_index,
                                    _mm256_extractf128_ps(x2_sum_256, 1));
     __m128 s_128 = _mm_add_ps(_mm256_extractf128_ps(s_256, 0),
                               _mm256_extractf128_ps(s_256, 1));
-    // Combine the accumulated vector and scalar values.
+    // Combine the accumulated vector values.
     float* v = reinterpret_cast<float*>(&x2_sum_128);
-    x2_sum += v[0] + v[1] + v[2] + v[3];
+    const float x2_sum = v[0] + v[1] + v[2] + v[3];
     v = reinterpret_cast<float*>(&s_128);
-    s += v[0] + v[1] + v[2] + v[3];
+    const float s = v[0] + v[1] + v[2] + v[3];
 
     // Compute the matched filter error.
     float e = y[i] - s;
@@ -98,34 +82,227 @@ void MatchedFilterCore_AVX2(size_t x_start_index,
       float* h_p = &h[0];
       x_p = &x[x_start_index];
 
-      // Perform the loop in two chunks.
-      for (int limit : {chunk1, chunk2}) {
-        // Perform 256 bit vector operations.
-        const int limit_by_8 = limit >> 3;
-        for (int k = limit_by_8; k > 0; --k, h_p += 8, x_p += 8) {
+      // Perform 256 bit vector operations.
+      for (int k = h_size >> 3; k > 0; --k, h_p += 8, x_p += 8) {
+        // Load the data into 256 bit vectors.
+        __m256 h_k = _mm256_loadu_ps(h_p);
+        __m256 x_k = _mm256_loadu_ps(x_p);
+        // Compute h = h + alpha * x.
+        h_k = _mm256_fmadd_ps(x_k, alpha_256, h_k);
+
+        // Store the result.
+        _mm256_storeu_ps(h_p, h_k);
+      }
+
+      *filters_updated = true;
+    }
+
+    x_start_index = x_start_index > 0 ? x_start_index - 1 : x_size - 1;
+  }
+}
+
+template <size_t kSubBlockSize, size_t kFilterLength, size_t kFilterShift>
+void MatchedFilterBankCore_AVX2(size_t x_start_index,
+                                size_t filter_shift,
+                                float x2_sum_threshold,
+                                float smoothing,
+                                rtc::ArrayView<const float> x,
+                                rtc::ArrayView<const float> y,
+                                rtc::ArrayView<float> h,
+                                rtc::ArrayView<bool> filters_updated,
+                                rtc::ArrayView<float> error_sums,
+                                rtc::ArrayView<float> x2_sums) {
+  const size_t num_filters = error_sums.size();
+  // The sizes that are known at compile time replace the given ones.
+  const size_t sub_block_size = kSubBlockSize > 0 ? kSubBlockSize : y.size();
+  const int h_size = static_cast<int>(
+      kFilterLength > 0 ? kFilterLength : h.size() / num_filters);
+  const int shift =
+      static_cast<int>(kFilterShift > 0 ? kFilterShift : filter_shift);
+  // The number of samples that each filter shares with the next one.
+  const int overlap = h_size > shift ? h_size - shift : 0;
+  // The size of the circular buffer that x mirrors.
+  const size_t x_size = x.size() / 2;
+  RTC_DCHECK_EQ(0, h_size % 8);
+  RTC_DCHECK_EQ(0, overlap % 8);
+  RTC_DCHECK_LE(2 * overlap, h_size);
+  RTC_DCHECK_GE(x_size, (num_filters - 1) * shift + h_size);
+  RTC_DCHECK_EQ(sub_block_size, y.size());
+  RTC_DCHECK_EQ(num_filters * h_size, h.size());
+  RTC_DCHECK_EQ(0u, reinterpret_cast<uintptr_t>(h.data()) % 32);
+  RTC_DCHECK_EQ(static_cast<size_t>(shift), filter_shift);
+  RTC_DCHECK_EQ(num_filters, filters_updated.size());
+  RTC_DCHECK_EQ(num_filters, error_sums.size());
+  RTC_DCHECK_EQ(num_filters, x2_sums.size());
+
+  // Apply the filters in groups that fit in the L1 cache, so that every group
+  // can be applied to the whole sub-block. Only the filters within a group
+  // share their overlaps.
+  const size_t group_size =
+      std::max<size_t>(1, kMatchedFilterBankGroupSamples / h_size);
+  for (size_t first = 0; first < num_filters; first += group_size) {
+    const size_t last = std::min(num_filters, first + group_size);
+
+    // Compute x * x for the first sample in the sub-block, computing the
+    // overlap of adjacent filters once.
+    __m256 x2_sum_256 = _mm256_set1_ps(0);
+    for (size_t n = first; n < last; ++n) {
+      const float* x_p = &x[x_start_index + n * shift];
+      const int begin = n > first ? overlap : 0;
+      const int end = n + 1 < last ? h_size - overlap : h_size;
+      for (int k = begin; k < end; k += 8) {
+        const __m256 x_k = _mm256_loadu_ps(x_p + k);
+        x2_sum_256 = _mm256_fmadd_ps(x_k, x_k, x2_sum_256);
+      }
+
+      __m256 next_x2_sum_256 = _mm256_set1_ps(0);
+      for (int k = end; k < h_size; k += 8) {
+        const __m256 x_k = _mm256_loadu_ps(x_p + k);
+        next_x2_sum_256 = _mm256_fmadd_ps(x_k, x_k, next_x2_sum_256);
+      }
+      x2_sum_256 = _mm256_add_ps(x2_sum_256, next_x2_sum_256);
+
+      __m128 x2_sum_128 = _mm_add_ps(_mm256_extractf128_ps(x2_sum_256, 0),
+                                     _mm256_extractf128_ps(x2_sum_256, 1));
+      float* v = reinterpret_cast<float*>(&x2_sum_128);
+      x2_sums[n] = v[0] + v[1] + v[2] + v[3];
+      x2_sum_256 = next_x2_sum_256;
+    }
+
+    // Process for all samples in the sub-block.
+    size_t x_index = x_start_index;
+    for (size_t i = 0; i < sub_block_size; ++i) {
+      RTC_DCHECK_GT(x_size, x_index);
+      const bool saturation = y[i] >= 32000.f || y[i] <= -32000.f;
+
+      // The accumulated value of the current filter, which may already hold
+      // the overlap with the previous filter.
+      __m256 s_256 = _mm256_set1_ps(0);
+      for (size_t n = first; n < last; ++n) {
+        const float* x_p = &x[x_index + n * shift];
+        const float* h_p = &h[n * h_size];
+
+        // Apply the matched filter as filter * x for the samples that are not
+        // shared with the previous or the next filter.
+        const int begin = n > first ? overlap : 0;
+        const int end = n + 1 < last ? h_size - overlap : h_size;
+        for (int k = begin; k < end; k += 8) {
           // Load the data into 256 bit vectors.
-          __m256 h_k = _mm256_loadu_ps(h_p);
-          __m256 x_k = _mm256_loadu_ps(x_p);
-          // Compute h = h + alpha * x.
-          h_k = _mm256_fmadd_ps(x_k, alpha_256, h_k);
+          const __m256 x_k = _mm256_loadu_ps(x_p + k);
+          const __m256 h_k = _mm256_load_ps(h_p + k);
+          // Compute and accumulate h * x.
+          s_256 = _mm256_fmadd_ps(h_k, x_k, s_256);
+        }
 
-          // Store the result.
-          _mm256_storeu_ps(h_p, h_k);
+        // Apply both this and the next filter to the samples they share.
+        __m256 next_s_256 = _mm256_set1_ps(0);
+        if (n + 1 < last) {
+          const float* next_h_p = &h[(n + 1) * h_size];
+          for (int k = end; k < h_size; k += 8) {
+            const __m256 x_k = _mm256_loadu_ps(x_p + k);
+            const __m256 h_k = _mm256_load_ps(h_p + k);
+            const __m256 next_h_k = _mm256_load_ps(next_h_p + k - end);
+            s_256 = _mm256_fmadd_ps(h_k, x_k, s_256);
+            next_s_256 = _mm256_fmadd_ps(next_h_k, x_k, next_s_256);
+          }
         }
 
-        // Perform non-vector operations for any remaining items.
-        for (int k = limit - limit_by_8 * 8; k > 0; --k, ++h_p, ++x_p) {
-          *h_p += alpha * *x_p;
+        // Sum components together.
+        __m128 s_128 = _mm_add_ps(_mm256_extractf128_ps(s_256, 0),
+                                  _mm256_extractf128_ps(s_256, 1));
+        float* v = reinterpret_cast<float*>(&s_128);
+        const float s = v[0] + v[1] + v[2] + v[3];
+        const float x2_sum = x2_sums[n];
+
+        // Compute the matched filter error.
+        float e = y[i] - s;
+        error_sums[n] += e * e;
+
+        // Update the matched filter estimate in an NLMS manner.
+        if (x2_sum > x2_sum_threshold && !saturation) {
+          RTC_DCHECK_LT(0.f, x2_sum);
+          const float alpha = smoothing * e / x2_sum;
+          const __m256 alpha_256 = _mm256_set1_ps(alpha);
+
+          // filter = filter + smoothing * (y - filter * x) * x / x * x.
+          float* h_p = &h[n * h_size];
+          for (int k = 0; k < h_size; k += 8) {
+            // Load the data into 256 bit vectors.
+            __m256 h_k = _mm256_load_ps(h_p + k);
+            const __m256 x_k = _mm256_loadu_ps(x_p + k);
+            // Compute h = h + alpha * x.
+            h_k = _mm256_fmadd_ps(x_k, alpha_256, h_k);
+
+            // Store the result.
+            _mm256_store_ps(h_p + k, h_k);
+          }
+          filters_updated[n] = true;
         }
 
-        x_p = &x[0];
+        s_256 = next_s_256;
       }
 
-      *filters_updated = true;
+      // Slide x * x of every filter one sample back.
+      const size_t next_x_index = x_index > 0 ? x_index - 1 : x_size - 1;
+      for (size_t n = first; n < last; ++n) {
+        const float x_in = x[next_x_index + n * shift];
+        const float x_out = x[x_index + n * shift + h_size - 1];
+        x2_sums[n] += x_in * x_in - x_out * x_out;
+      }
+      x_index = next_x_index;
     }
+  }
+}
 
-    x_start_index = x_start_index > 0 ? x_start_index - 1 : x_size - 1;
+#define INSTANTIATE_MATCHED_FILTER_BANK_CORE(sub_block_size, filter_length,   \
+                                             filter_shift)                    \
+  template void                                                               \
+  MatchedFilterBankCore_AVX2<sub_block_size, filter_length, filter_shift>(    \
+      size_t, size_t, float, float, rtc::ArrayView<const float>,              \
+      rtc::ArrayView<const float>, rtc::ArrayView<float>,                     \
+      rtc::ArrayView<bool>, rtc::ArrayView<float>, rtc::ArrayView<float>);
+MATCHED_FILTER_BANK_SPECIALIZATIONS(INSTANTIATE_MATCHED_FILTER_BANK_CORE)
+#undef INSTANTIATE_MATCHED_FILTER_BANK_CORE
+
+size_t MaxSquarePeakIndex_AVX2(rtc::ArrayView<const float> h) {
+  const int h_size = static_cast<int>(h.size());
+  RTC_DCHECK_EQ(0, h_size % 8);
+  RTC_DCHECK_LT(0, h_size);
+
+  // Track the largest square and its index in each lane. A lane only moves to
+  // a later index when its square is strictly larger, which keeps the first
+  // one of equal squares.
+  const __m256 h_0 = _mm256_loadu_ps(&h[0]);
+  __m256 max_256 = _mm256_mul_ps(h_0, h_0);
+  __m256i index_256 = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i max_index_256 = index_256;
+  const __m256i step_256 = _mm256_set1_epi32(8);
+  for (int k = 8; k < h_size; k += 8) {
+    const __m256 h_k = _mm256_loadu_ps(&h[k]);
+    const __m256 square = _mm256_mul_ps(h_k, h_k);
+    index_256 = _mm256_add_epi32(index_256, step_256);
+    const __m256 larger = _mm256_cmp_ps(square, max_256, _CMP_GT_OQ);
+    max_256 = _mm256_max_ps(max_256, square);
+    max_index_256 = _mm256_castps_si256(
+        _mm256_blendv_ps(_mm256_castsi256_ps(max_index_256),
+                         _mm256_castsi256_ps(index_256), larger));
+  }
+
+  // Combine the lanes, preferring the lowest index among equal squares.
+  float max[8];
+  int32_t max_index[8];
+  _mm256_storeu_ps(max, max_256);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(max_index), max_index_256);
+  size_t peak_index = max_index[0];
+  float peak = max[0];
+  for (int k = 1; k < 8; ++k) {
+    const size_t index = static_cast<size_t>(max_index[k]);
+    if (max[k] > peak || (max[k] == peak && index < peak_index)) {
+      peak = max[k];
+      peak_index = index;
+    }
   }
+  return peak_index;
 }
 
 }  // namespace aec3
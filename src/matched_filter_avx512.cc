@@ -0,0 +1,255 @@
+/*
+ *  Copyright (c) 2020 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "matched_filter.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cstdint>
+
+#include "checks.h"
+
+namespace webrtc {
+namespace aec3 {
+
+void MatchedFilterCore_AVX512(size_t x_start_index,
+                              float x2_sum_threshold,
+                              float smoothing,
+                              rtc::ArrayView<const float> x,
+                              rtc::ArrayView<const float> y,
+                              rtc::ArrayView<float> h,
+                              bool* filters_updated,
+                              float* error_sum) {
+  const int h_size = static_cast<int>(h.size());
+  // The size of the circular buffer that x mirrors.
+  const size_t x_size = x.size() / 2;
+  RTC_DCHECK_EQ(0, h_size % 16);
+  RTC_DCHECK_GE(x_size, h.size());
+
+  // Process for all samples in the sub-block.
+  for (size_t i = 0; i < y.size(); ++i) {
+    // Apply the matched filter as filter * x, and compute x * x.
+
+    RTC_DCHECK_GT(x_size, x_start_index);
+    const float* x_p = &x[x_start_index];
+    const float* h_p = &h[0];
+
+    // Initialize values for the accumulation.
+    __m512 s_512 = _mm512_setzero_ps();
+    __m512 x2_sum_512 = _mm512_setzero_ps();
+
+    // Perform 512 bit vector operations.
+    for (int k = h_size >> 4; k > 0; --k, h_p += 16, x_p += 16) {
+      // Load the data into 512 bit vectors.
+      __m512 x_k = _mm512_loadu_ps(x_p);
+      __m512 h_k = _mm512_loadu_ps(h_p);
+      // Compute and accumulate x * x and h * x.
+      x2_sum_512 = _mm512_fmadd_ps(x_k, x_k, x2_sum_512);
+      s_512 = _mm512_fmadd_ps(h_k, x_k, s_512);
+    }
+
+    // Sum components together.
+    const float x2_sum = _mm512_reduce_add_ps(x2_sum_512);
+    const float s = _mm512_reduce_add_ps(s_512);
+
+    // Compute the matched filter error.
+    float e = y[i] - s;
+    const bool saturation = y[i] >= 32000.f || y[i] <= -32000.f;
+    (*error_sum) += e * e;
+
+    // Update the matched filter estimate in an NLMS manner.
+    if (x2_sum > x2_sum_threshold && !saturation) {
+      RTC_DCHECK_LT(0.f, x2_sum);
+      const float alpha = smoothing * e / x2_sum;
+      const __m512 alpha_512 = _mm512_set1_ps(alpha);
+
+      // filter = filter + smoothing * (y - filter * x) * x / x * x.
+      float* h_p = &h[0];
+      x_p = &x[x_start_index];
+
+      // Perform 512 bit vector operations.
+      for (int k = h_size >> 4; k > 0; --k, h_p += 16, x_p += 16) {
+        // Load the data into 512 bit vectors.
+        __m512 h_k = _mm512_loadu_ps(h_p);
+        __m512 x_k = _mm512_loadu_ps(x_p);
+        // Compute h = h + alpha * x.
+        h_k = _mm512_fmadd_ps(x_k, alpha_512, h_k);
+
+        // Store the result.
+        _mm512_storeu_ps(h_p, h_k);
+      }
+
+      *filters_updated = true;
+    }
+
+    x_start_index = x_start_index > 0 ? x_start_index - 1 : x_size - 1;
+  }
+}
+
+template <size_t kSubBlockSize, size_t kFilterLength, size_t kFilterShift>
+void MatchedFilterBankCore_AVX512(size_t x_start_index,
+                                  size_t filter_shift,
+                                  float x2_sum_threshold,
+                                  float smoothing,
+                                  rtc::ArrayView<const float> x,
+                                  rtc::ArrayView<const float> y,
+                                  rtc::ArrayView<float> h,
+                                  rtc::ArrayView<bool> filters_updated,
+                                  rtc::ArrayView<float> error_sums,
+                                  rtc::ArrayView<float> x2_sums) {
+  const size_t num_filters = error_sums.size();
+  // The sizes that are known at compile time replace the given ones.
+  const size_t sub_block_size = kSubBlockSize > 0 ? kSubBlockSize : y.size();
+  const int h_size = static_cast<int>(
+      kFilterLength > 0 ? kFilterLength : h.size() / num_filters);
+  const int shift =
+      static_cast<int>(kFilterShift > 0 ? kFilterShift : filter_shift);
+  // The number of samples that each filter shares with the next one.
+  const int overlap = h_size > shift ? h_size - shift : 0;
+  // The size of the circular buffer that x mirrors.
+  const size_t x_size = x.size() / 2;
+  RTC_DCHECK_EQ(0, h_size % 16);
+  RTC_DCHECK_EQ(0, overlap % 16);
+  RTC_DCHECK_LE(2 * overlap, h_size);
+  RTC_DCHECK_GE(x_size, (num_filters - 1) * shift + h_size);
+  RTC_DCHECK_EQ(sub_block_size, y.size());
+  RTC_DCHECK_EQ(num_filters * h_size, h.size());
+  RTC_DCHECK_EQ(0u, reinterpret_cast<uintptr_t>(h.data()) % 64);
+  RTC_DCHECK_EQ(static_cast<size_t>(shift), filter_shift);
+  RTC_DCHECK_EQ(num_filters, filters_updated.size());
+  RTC_DCHECK_EQ(num_filters, error_sums.size());
+  RTC_DCHECK_EQ(num_filters, x2_sums.size());
+
+  // Apply the filters in groups that fit in the L1 cache, so that every group
+  // can be applied to the whole sub-block. Only the filters within a group
+  // share their overlaps.
+  const size_t group_size =
+      std::max<size_t>(1, kMatchedFilterBankGroupSamples / h_size);
+  for (size_t first = 0; first < num_filters; first += group_size) {
+    const size_t last = std::min(num_filters, first + group_size);
+
+    // Compute x * x for the first sample in the sub-block, computing the
+    // overlap of adjacent filters once.
+    __m512 x2_sum_512 = _mm512_setzero_ps();
+    for (size_t n = first; n < last; ++n) {
+      const float* x_p = &x[x_start_index + n * shift];
+      const int begin = n > first ? overlap : 0;
+      const int end = n + 1 < last ? h_size - overlap : h_size;
+      for (int k = begin; k < end; k += 16) {
+        const __m512 x_k = _mm512_loadu_ps(x_p + k);
+        x2_sum_512 = _mm512_fmadd_ps(x_k, x_k, x2_sum_512);
+      }
+
+      __m512 next_x2_sum_512 = _mm512_setzero_ps();
+      for (int k = end; k < h_size; k += 16) {
+        const __m512 x_k = _mm512_loadu_ps(x_p + k);
+        next_x2_sum_512 = _mm512_fmadd_ps(x_k, x_k, next_x2_sum_512);
+      }
+      x2_sum_512 = _mm512_add_ps(x2_sum_512, next_x2_sum_512);
+
+      x2_sums[n] = _mm512_reduce_add_ps(x2_sum_512);
+      x2_sum_512 = next_x2_sum_512;
+    }
+
+    // Process for all samples in the sub-block.
+    size_t x_index = x_start_index;
+    for (size_t i = 0; i < sub_block_size; ++i) {
+      RTC_DCHECK_GT(x_size, x_index);
+      const bool saturation = y[i] >= 32000.f || y[i] <= -32000.f;
+
+      // The accumulated value of the current filter, which may already hold
+      // the overlap with the previous filter.
+      __m512 s_512 = _mm512_setzero_ps();
+      for (size_t n = first; n < last; ++n) {
+        const float* x_p = &x[x_index + n * shift];
+        const float* h_p = &h[n * h_size];
+
+        // Apply the matched filter as filter * x for the samples that are not
+        // shared with the previous or the next filter.
+        const int begin = n > first ? overlap : 0;
+        const int end = n + 1 < last ? h_size - overlap : h_size;
+        for (int k = begin; k < end; k += 16) {
+          // Load the data into 512 bit vectors.
+          const __m512 x_k = _mm512_loadu_ps(x_p + k);
+          const __m512 h_k = _mm512_load_ps(h_p + k);
+          // Compute and accumulate h * x.
+          s_512 = _mm512_fmadd_ps(h_k, x_k, s_512);
+        }
+
+        // Apply both this and the next filter to the samples they share.
+        __m512 next_s_512 = _mm512_setzero_ps();
+        if (n + 1 < last) {
+          const float* next_h_p = &h[(n + 1) * h_size];
+          for (int k = end; k < h_size; k += 16) {
+            const __m512 x_k = _mm512_loadu_ps(x_p + k);
+            const __m512 h_k = _mm512_load_ps(h_p + k);
+            const __m512 next_h_k = _mm512_load_ps(next_h_p + k - end);
+            s_512 = _mm512_fmadd_ps(h_k, x_k, s_512);
+            next_s_512 = _mm512_fmadd_ps(next_h_k, x_k, next_s_512);
+          }
+        }
+
+        // Sum components together.
+        const float s = _mm512_reduce_add_ps(s_512);
+        const float x2_sum = x2_sums[n];
+
+        // Compute the matched filter error.
+        float e = y[i] - s;
+        error_sums[n] += e * e;
+
+        // Update the matched filter estimate in an NLMS manner.
+        if (x2_sum > x2_sum_threshold && !saturation) {
+          RTC_DCHECK_LT(0.f, x2_sum);
+          const float alpha = smoothing * e / x2_sum;
+          const __m512 alpha_512 = _mm512_set1_ps(alpha);
+
+          // filter = filter + smoothing * (y - filter * x) * x / x * x.
+          float* h_p = &h[n * h_size];
+          for (int k = 0; k < h_size; k += 16) {
+            // Load the data into 512 bit vectors.
+            __m512 h_k = _mm512_load_ps(h_p + k);
+            const __m512 x_k = _mm512_loadu_ps(x_p + k);
+            // Compute h = h + alpha * x.
+            h_k = _mm512_fmadd_ps(x_k, alpha_512, h_k);
+
+            // Store the result.
+            _mm512_store_ps(h_p + k, h_k);
+          }
+          filters_updated[n] = true;
+        }
+
+        s_512 = next_s_512;
+      }
+
+      // Slide x * x of every filter one sample back.
+      const size_t next_x_index = x_index > 0 ? x_index - 1 : x_size - 1;
+      for (size_t n = first; n < last; ++n) {
+        const float x_in = x[next_x_index + n * shift];
+        const float x_out = x[x_index + n * shift + h_size - 1];
+        x2_sums[n] += x_in * x_in - x_out * x_out;
+      }
+      x_index = next_x_index;
+    }
+  }
+}
+
+#define INSTANTIATE_MATCHED_FILTER_BANK_CORE(sub_block_size, filter_length,   \
+                                             filter_shift)                    \
+  template void                                                               \
+  MatchedFilterBankCore_AVX512<sub_block_size, filter_length, filter_shift>(  \
+      size_t, size_t, float, float, rtc::ArrayView<const float>,              \
+      rtc::ArrayView<const float>, rtc::ArrayView<float>,                     \
+      rtc::ArrayView<bool>, rtc::ArrayView<float>, rtc::ArrayView<float>);
+MATCHED_FILTER_BANK_SPECIALIZATIONS(INSTANTIATE_MATCHED_FILTER_BANK_CORE)
+#undef INSTANTIATE_MATCHED_FILTER_BANK_CORE
+
+}  // namespace aec3
+}  // namespace webrtc
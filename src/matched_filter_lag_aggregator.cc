@@ -10,23 +10,39 @@
 #include "matched_filter_lag_aggregator.h"
 
 #include <algorithm>
-#include <iterator>
 
 #include "apm_data_dumper.h"
 #include "checks.h"
 
 namespace webrtc {
+namespace {
+
+// Lags that are at most this far from a candidate with more votes are taken as
+// the peak of the same echo path, which moves by a few lags between filters
+// and blocks.
+constexpr size_t kMinCandidateSeparation = 8;
+
+}  // namespace
 
 MatchedFilterLagAggregator::MatchedFilterLagAggregator(
     ApmDataDumper* data_dumper,
     size_t max_filter_lag,
-    const EchoCanceller3Config::Delay::DelaySelectionThresholds& thresholds)
+    const EchoCanceller3Config::Delay::DelaySelectionThresholds& thresholds,
+    bool track_candidates)
     : data_dumper_(data_dumper),
       histogram_(max_filter_lag + 1, 0),
-      thresholds_(thresholds) {
+      thresholds_(thresholds),
+      track_candidates_(track_candidates) {
   RTC_DCHECK(data_dumper);
+  RTC_DCHECK_LE(0, thresholds_.initial);
   RTC_DCHECK_LE(thresholds_.initial, thresholds_.converged);
   histogram_data_.fill(0);
+  num_bins_with_count_.fill(0);
+  if (track_candidates_) {
+    candidate_histogram_.resize(max_filter_lag + 1, 0);
+    candidate_accuracies_.resize(max_filter_lag + 1, 0.f);
+    candidate_positions_.resize(max_filter_lag + 1, -1);
+  }
 }
 
 MatchedFilterLagAggregator::~MatchedFilterLagAggregator() = default;
@@ -35,6 +51,16 @@ void MatchedFilterLagAggregator::Reset(bool hard_reset) {
   std::fill(histogram_.begin(), histogram_.end(), 0);
   histogram_data_.fill(0);
   histogram_data_index_ = 0;
+  num_bins_with_count_.fill(0);
+  max_count_ = 0;
+  mode_ = 0;
+  for (auto& votes : candidate_votes_) {
+    for (int lag : votes) {
+      RemoveCandidateVote(lag);
+    }
+    votes.clear();
+  }
+  candidate_votes_index_ = 0;
   if (hard_reset) {
     significant_candidate_found_ = false;
   }
@@ -54,29 +80,52 @@ absl::optional<DelayEstimate> MatchedFilterLagAggregator::Aggregate(
     }
   }
 
+  // Let every filter that explains enough of the capture vote for the
+  // candidates, replacing the votes of the oldest block.
+  if (track_candidates_) {
+    std::vector<int>& votes = candidate_votes_[candidate_votes_index_];
+    for (int lag : votes) {
+      RemoveCandidateVote(lag);
+    }
+    votes.clear();
+    for (const auto& lag_estimate : lag_estimates) {
+      if (!lag_estimate.updated || !lag_estimate.candidate) {
+        continue;
+      }
+      const int lag = static_cast<int>(lag_estimate.lag);
+      if (std::find(votes.begin(), votes.end(), lag) != votes.end()) {
+        candidate_accuracies_[lag] = std::max(candidate_accuracies_[lag],
+                                              lag_estimate.explained_energy);
+        continue;
+      }
+      votes.push_back(lag);
+      AddCandidateVote(lag, lag_estimate.explained_energy);
+    }
+    candidate_votes_index_ =
+        (candidate_votes_index_ + 1) % candidate_votes_.size();
+  }
+
   // TODO(peah): Remove this logging once all development is done.
   data_dumper_->DumpRaw("aec3_echo_path_delay_estimator_best_index",
                         best_lag_estimate_index);
   data_dumper_->DumpRaw("aec3_echo_path_delay_estimator_histogram", histogram_);
 
   if (best_lag_estimate_index != -1) {
-    RTC_DCHECK_GT(histogram_.size(), histogram_data_[histogram_data_index_]);
-    RTC_DCHECK_LE(0, histogram_data_[histogram_data_index_]);
-    --histogram_[histogram_data_[histogram_data_index_]];
+    const int lag = lag_estimates[best_lag_estimate_index].lag;
+    RTC_DCHECK_GT(histogram_.size(), lag);
+    RTC_DCHECK_LE(0, lag);
 
-    histogram_data_[histogram_data_index_] =
-        lag_estimates[best_lag_estimate_index].lag;
-
-    RTC_DCHECK_GT(histogram_.size(), histogram_data_[histogram_data_index_]);
-    RTC_DCHECK_LE(0, histogram_data_[histogram_data_index_]);
-    ++histogram_[histogram_data_[histogram_data_index_]];
+    // A vote that replaces one for the same lag leaves the histogram as it is.
+    if (histogram_data_[histogram_data_index_] != lag) {
+      RemoveFromHistogram(histogram_data_[histogram_data_index_]);
+      histogram_data_[histogram_data_index_] = lag;
+      AddToHistogram(lag);
+    }
 
     histogram_data_index_ =
         (histogram_data_index_ + 1) % histogram_data_.size();
 
-    const int candidate =
-        std::distance(histogram_.begin(),
-                      std::max_element(histogram_.begin(), histogram_.end()));
+    const int candidate = mode_;
 
     significant_candidate_found_ =
         significant_candidate_found_ ||
@@ -94,4 +143,116 @@ absl::optional<DelayEstimate> MatchedFilterLagAggregator::Aggregate(
   return absl::nullopt;
 }
 
+void MatchedFilterLagAggregator::GetCandidates(
+    size_t max_candidates,
+    std::vector<Candidate>* candidates) const {
+  RTC_DCHECK(candidates);
+  candidates->clear();
+  // A lag needs as many votes as the combined estimate needs to be reported,
+  // which leaves out the lags that a filter found by chance.
+  for (int lag : candidate_lags_) {
+    if (candidate_histogram_[lag] > thresholds_.initial) {
+      candidates->emplace_back(lag, candidate_histogram_[lag],
+                               candidate_accuracies_[lag]);
+    }
+  }
+  std::sort(candidates->begin(), candidates->end(),
+            [](const Candidate& a, const Candidate& b) {
+              return a.votes > b.votes || (a.votes == b.votes && a.lag < b.lag);
+            });
+
+  // Keep the candidates that are far enough from those with more votes.
+  size_t num_kept = 0;
+  for (size_t k = 0; k < candidates->size() && num_kept < max_candidates;
+       ++k) {
+    const size_t lag = (*candidates)[k].lag;
+    const bool separate = std::none_of(
+        candidates->begin(), candidates->begin() + num_kept,
+        [lag](const Candidate& kept) {
+          return (lag > kept.lag ? lag - kept.lag : kept.lag - lag) <=
+                 kMinCandidateSeparation;
+        });
+    if (separate) {
+      (*candidates)[num_kept++] = (*candidates)[k];
+    }
+  }
+  candidates->resize(num_kept);
+}
+
+void MatchedFilterLagAggregator::AddCandidateVote(int lag, float accuracy) {
+  RTC_DCHECK_GT(candidate_histogram_.size(), lag);
+  RTC_DCHECK_LE(0, lag);
+  if (candidate_histogram_[lag]++ == 0) {
+    candidate_positions_[lag] = static_cast<int>(candidate_lags_.size());
+    candidate_lags_.push_back(lag);
+  }
+  candidate_accuracies_[lag] = accuracy;
+}
+
+void MatchedFilterLagAggregator::RemoveCandidateVote(int lag) {
+  RTC_DCHECK_LT(0, candidate_histogram_[lag]);
+  if (--candidate_histogram_[lag] > 0) {
+    return;
+  }
+
+  // Move the last listed lag into the place of the removed one.
+  const int position = candidate_positions_[lag];
+  RTC_DCHECK_LE(0, position);
+  candidate_lags_[position] = candidate_lags_.back();
+  candidate_positions_[candidate_lags_[position]] = position;
+  candidate_lags_.pop_back();
+  candidate_positions_[lag] = -1;
+}
+
+void MatchedFilterLagAggregator::AddToHistogram(int lag) {
+  const int count = ++histogram_[lag];
+  if (count > 1) {
+    --num_bins_with_count_[count - 1];
+  }
+  if (count > 0) {
+    ++num_bins_with_count_[count];
+  }
+
+  if (count > max_count_) {
+    max_count_ = count;
+    mode_ = lag;
+  } else if (count == max_count_ && lag < mode_) {
+    mode_ = lag;
+  }
+}
+
+void MatchedFilterLagAggregator::RemoveFromHistogram(int lag) {
+  RTC_DCHECK_GT(histogram_.size(), lag);
+  RTC_DCHECK_LE(0, lag);
+  const int count = histogram_[lag]--;
+  if (count > 0) {
+    --num_bins_with_count_[count];
+  }
+  if (count > 1) {
+    ++num_bins_with_count_[count - 1];
+  }
+
+  // Removing a vote only moves the mode if the vote is for the mode.
+  if (max_count_ == 0 || lag != mode_ || count != max_count_) {
+    return;
+  }
+  if (num_bins_with_count_[max_count_] == 0) {
+    --max_count_;
+  }
+  if (max_count_ == 0) {
+    mode_ = 0;
+    return;
+  }
+
+  // Every lag with a positive count has a vote in the history, so the new mode
+  // is found there without scanning the histogram.
+  mode_ = static_cast<int>(histogram_.size());
+  for (int l : histogram_data_) {
+    if (histogram_[l] == max_count_) {
+      mode_ = std::min(mode_, l);
+    }
+  }
+  RTC_DCHECK_GT(histogram_.size(), mode_);
+}
+
 }  // namespace webrtc
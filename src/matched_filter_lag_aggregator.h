@@ -11,6 +11,7 @@
 #ifndef MODULES_AUDIO_PROCESSING_AEC3_MATCHED_FILTER_LAG_AGGREGATOR_H_
 #define MODULES_AUDIO_PROCESSING_AEC3_MATCHED_FILTER_LAG_AGGREGATOR_H_
 
+#include <array>
 #include <vector>
 
 #include "absl/types/optional.h"
@@ -26,10 +27,29 @@ class ApmDataDumper;
 // reliable combined lag estimate.
 class MatchedFilterLagAggregator {
  public:
+  // A lag that the filters have found in the last blocks, besides the one that
+  // the single combined estimate is based on.
+  struct Candidate {
+    Candidate() = default;
+    Candidate(size_t lag, int votes, float accuracy)
+        : lag(lag), votes(votes), accuracy(accuracy) {}
+
+    size_t lag = 0;
+    // The mass of the lag in the histogram of the candidates, which is the
+    // number of the last blocks where a candidate filter found the lag.
+    int votes = 0;
+    // The fraction of the capture energy explained by the filter that found
+    // the lag most recently.
+    float accuracy = 0.f;
+  };
+
+  // The candidates are only tracked if |track_candidates| is set, as every
+  // candidate filter then votes on every block.
   MatchedFilterLagAggregator(
       ApmDataDumper* data_dumper,
       size_t max_filter_lag,
-      const EchoCanceller3Config::Delay::DelaySelectionThresholds& thresholds);
+      const EchoCanceller3Config::Delay::DelaySelectionThresholds& thresholds,
+      bool track_candidates);
 
   MatchedFilterLagAggregator() = delete;
   MatchedFilterLagAggregator(const MatchedFilterLagAggregator&) = delete;
@@ -45,13 +65,49 @@ class MatchedFilterLagAggregator {
   absl::optional<DelayEstimate> Aggregate(
       rtc::ArrayView<const MatchedFilter::LagEstimate> lag_estimates);
 
+  // Returns at most |max_candidates| candidates in |candidates|, by decreasing
+  // number of votes. Lags with no more votes than the initial threshold are
+  // left out, and so is a lag that is close to a candidate with more votes,
+  // as it is taken as the same echo path.
+  void GetCandidates(size_t max_candidates,
+                     std::vector<Candidate>* candidates) const;
+
  private:
+  // Adds or removes one vote for |lag| in the histogram, keeping track of its
+  // mode.
+  void AddToHistogram(int lag);
+  void RemoveFromHistogram(int lag);
+
+  // Adds or removes one vote for |lag| in the histogram of the candidates.
+  void AddCandidateVote(int lag, float accuracy);
+  void RemoveCandidateVote(int lag);
+
   ApmDataDumper* const data_dumper_;
   std::vector<int> histogram_;
   std::array<int, 250> histogram_data_;
   int histogram_data_index_ = 0;
   bool significant_candidate_found_ = false;
   const EchoCanceller3Config::Delay::DelaySelectionThresholds thresholds_;
+  // The number of histogram bins that hold each positive count, which tells
+  // whether a bin is the only one at the highest count.
+  std::array<int, 251> num_bins_with_count_;
+  // The highest count in the histogram and the lowest lag that has it, which
+  // is what std::max_element over the histogram would find. Only positive
+  // counts are tracked, as the thresholds are never negative.
+  int max_count_ = 0;
+  int mode_ = 0;
+
+  // The histogram of the candidates, with the lags found by every candidate
+  // filter in the last blocks, at most once per block. Only the lags that
+  // have votes are listed in |candidate_lags_|, and |candidate_positions_|
+  // holds where, or -1, so that a lag is added and removed in O(1).
+  const bool track_candidates_;
+  std::vector<int> candidate_histogram_;
+  std::vector<float> candidate_accuracies_;
+  std::vector<int> candidate_lags_;
+  std::vector<int> candidate_positions_;
+  std::array<std::vector<int>, 250> candidate_votes_;
+  size_t candidate_votes_index_ = 0;
 };
 }  // namespace webrtc
 
@@ -0,0 +1,60 @@
+/*
+ * http://www.kurims.kyoto-u.ac.jp/~ooura/fft.html
+ * Copyright Takuya OOURA, 1996-2001
+ *
+ * You may use, copy, modify and distribute this code for any purpose (include
+ * commercial use) and without fee. Please refer to this package when you modify
+ * this code.
+ */
+
+#ifndef OOURA_REAL_FFT_H_
+#define OOURA_REAL_FFT_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+namespace webrtc {
+
+// Real FFT of any power-of-two size of at least 8 points. This is the general
+// version of the transform that OouraFft specializes to 128 points, and uses
+// the same data layout: the forward transform replaces the input with
+// a[0] = R[0], a[1] = R[n/2] and a[2k] = R[k], a[2k+1] = I[k] for
+// 0 < k < n/2, where I[k] is computed with a positive sine. The inverse
+// transform is not normalized, so that a forward transform followed by an
+// inverse one scales the input by n/2.
+class OouraRealFft {
+ public:
+  explicit OouraRealFft(size_t fft_size);
+  ~OouraRealFft();
+  OouraRealFft(const OouraRealFft&) = delete;
+  OouraRealFft& operator=(const OouraRealFft&) = delete;
+
+  size_t size() const { return fft_size_; }
+
+  void Fft(float* a) const;
+  void InverseFft(float* a) const;
+
+ private:
+  void MakeTwiddleTable();
+  void MakeCosineTable();
+
+  void cftfsub(float* a) const;
+  void cftbsub(float* a) const;
+  void cft1st(float* a) const;
+  void cftmdl(size_t l, float* a) const;
+  void rftfsub(float* a) const;
+  void rftbsub(float* a) const;
+
+  const size_t fft_size_;
+
+  // Bit reversal table and the twiddle factors of the complex transform
+  // (w_) and of the real-valued post-processing (c_).
+  std::vector<size_t> ip_;
+  std::vector<float> w_;
+  std::vector<float> c_;
+};
+
+}  // namespace webrtc
+
+#endif  // OOURA_REAL_FFT_H_
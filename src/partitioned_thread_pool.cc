@@ -0,0 +1,131 @@
+#include "partitioned_thread_pool.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "atomic_ops.h"
+#include "checks.h"
+#include "platform_thread_types.h"
+#include "yield.h"
+
+namespace webrtc {
+namespace {
+
+// Number of times a thread yields while it waits for the others, before it
+// blocks. This covers the gap between the blocks of an input that is processed
+// as fast as possible, but lets an idle pool give its cores back within about a
+// millisecond.
+constexpr int kMaxSpins = 1000;
+
+// Yields until |condition| returns true, at most kMaxSpins times, and returns
+// whether it did.
+template <typename Condition>
+bool SpinUntil(Condition condition) {
+  for (int i = 0; i < kMaxSpins; ++i) {
+    if (condition()) {
+      return true;
+    }
+    YieldCurrentThread();
+  }
+  return condition();
+}
+
+}  // namespace
+
+PartitionedThreadPool::PartitionedThreadPool(size_t num_threads,
+                                             size_t num_items,
+                                             Task task)
+    : task_(std::move(task)) {
+  RTC_DCHECK_LT(0, num_threads);
+  RTC_DCHECK_LE(num_threads, num_items);
+  RTC_DCHECK(task_);
+
+  // Spread the remainder over the first parts, so that the sizes differ by
+  // at most one item.
+  for (size_t part = 0; part <= num_threads; ++part) {
+    part_starts_.push_back(part * (num_items / num_threads) +
+                           std::min(part, num_items % num_threads));
+  }
+  max_part_size_ = (num_items + num_threads - 1) / num_threads;
+
+  for (size_t part = 1; part < num_threads; ++part) {
+    workers_.emplace_back(&PartitionedThreadPool::WorkerLoop, this, part);
+  }
+}
+
+PartitionedThreadPool::~PartitionedThreadPool() {
+  rtc::AtomicOps::ReleaseStore(&stopping_, 1);
+  rtc::AtomicOps::Increment(&round_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wake_workers_.notify_all();
+  }
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void PartitionedThreadPool::Run() {
+  // The increment is a full barrier, so the workers see everything the caller
+  // wrote before it.
+  rtc::AtomicOps::ReleaseStore(&pending_workers_,
+                               static_cast<int>(workers_.size()));
+  rtc::AtomicOps::Increment(&round_);
+  // A worker counts itself as sleeping before it checks round_ a last time,
+  // and both are full barriers, so either it sees the new round or it is
+  // counted here and waits on wake_workers_ once mutex_ is free.
+  if (rtc::AtomicOps::AcquireLoad(&sleeping_workers_) != 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wake_workers_.notify_all();
+  }
+
+  task_(part_starts_[0], part_starts_[1]);
+
+  auto workers_done = [this] {
+    return rtc::AtomicOps::AcquireLoad(&pending_workers_) == 0;
+  };
+  if (!SpinUntil(workers_done)) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    rtc::AtomicOps::Increment(&sleeping_caller_);
+    workers_done_.wait(lock, workers_done);
+    rtc::AtomicOps::Decrement(&sleeping_caller_);
+  }
+}
+
+void PartitionedThreadPool::WorkerLoop(size_t part) {
+  const std::string name = "pool_worker_" + std::to_string(part);
+  rtc::SetCurrentThreadName(name.c_str());
+
+  // Run cannot be called before the constructor returns, and it waits for
+  // every worker, so a worker never misses a round.
+  int last_round = 0;
+  while (true) {
+    auto new_round = [this, &last_round] {
+      return rtc::AtomicOps::AcquireLoad(&round_) != last_round;
+    };
+    if (!SpinUntil(new_round)) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      rtc::AtomicOps::Increment(&sleeping_workers_);
+      wake_workers_.wait(lock, new_round);
+      rtc::AtomicOps::Decrement(&sleeping_workers_);
+    }
+    last_round = rtc::AtomicOps::AcquireLoad(&round_);
+    if (rtc::AtomicOps::AcquireLoad(&stopping_) != 0) {
+      return;
+    }
+
+    task_(part_starts_[part], part_starts_[part + 1]);
+
+    // The decrement is a full barrier, so the caller sees everything the task
+    // wrote once all the workers are done. As in Run, the caller either sees
+    // the last decrement or is counted as sleeping before it.
+    if (rtc::AtomicOps::Decrement(&pending_workers_) == 0 &&
+        rtc::AtomicOps::AcquireLoad(&sleeping_caller_) != 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      workers_done_.notify_one();
+    }
+  }
+}
+
+}  // namespace webrtc
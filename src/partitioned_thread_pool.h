@@ -0,0 +1,68 @@
+#ifndef PARTITIONED_THREAD_POOL_H_
+#define PARTITIONED_THREAD_POOL_H_
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace webrtc {
+
+// Runs a task over [0, num_items) split into one contiguous part per thread.
+// Every thread always runs the same part, and the calling thread runs the first
+// one, so that a pool of n threads only starts n - 1 workers. The workers live
+// as long as the pool and wait for the next call to Run by yielding in a loop
+// for a while, which starts them without a system call, and then block until
+// it comes, so that an idle pool does not keep its cores busy. Run waits for
+// the workers in the same way.
+class PartitionedThreadPool {
+ public:
+  // Runs the items from |first| up to, but not including, |last|.
+  using Task = std::function<void(size_t first, size_t last)>;
+
+  PartitionedThreadPool(size_t num_threads, size_t num_items, Task task);
+  ~PartitionedThreadPool();
+  PartitionedThreadPool(const PartitionedThreadPool&) = delete;
+  PartitionedThreadPool& operator=(const PartitionedThreadPool&) = delete;
+
+  // Runs the task on every part and returns once all of them are done.
+  void Run();
+
+  // Returns the number of threads, including the calling one.
+  size_t num_threads() const { return part_starts_.size() - 1; }
+
+  // Returns the largest number of items in one part.
+  size_t max_part_size() const { return max_part_size_; }
+
+ private:
+  void WorkerLoop(size_t part);
+
+  const Task task_;
+  // The first item of every part, followed by the number of items.
+  std::vector<size_t> part_starts_;
+  size_t max_part_size_ = 0;
+  std::vector<std::thread> workers_;
+
+  // Incremented to start the workers on a new round.
+  volatile int round_ = 0;
+  // Number of workers that have not finished the current round.
+  volatile int pending_workers_ = 0;
+  // Set to make the workers return at the start of the next round.
+  volatile int stopping_ = 0;
+
+  // Number of workers blocked on wake_workers_, and whether the caller of Run
+  // is blocked on workers_done_. They are only incremented with mutex_ held,
+  // right before the wait.
+  volatile int sleeping_workers_ = 0;
+  volatile int sleeping_caller_ = 0;
+  std::mutex mutex_;
+  std::condition_variable wake_workers_;
+  std::condition_variable workers_done_;
+};
+
+}  // namespace webrtc
+
+#endif  // PARTITIONED_THREAD_POOL_H_
@@ -70,6 +70,14 @@ class RenderDelayBuffer {
   // Returns the downsampled render buffer.
   virtual const DownsampledRenderBuffer& GetDownsampledRenderBuffer() const = 0;
 
+  // Returns the downsampled render buffer used by the fine stage of the delay
+  // search. Buffers that do not maintain one return the regular downsampled
+  // render buffer.
+  virtual const DownsampledRenderBuffer& GetFineDownsampledRenderBuffer()
+      const {
+    return GetDownsampledRenderBuffer();
+  }
+
   // Returns the maximum non calusal offset that can occur in the delay buffer.
   static int DelayEstimatorOffset(const EchoCanceller3Config& config);
 
@@ -0,0 +1,136 @@
+/*
+ *  Copyright (c) 2018 The WebRTC project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef MODULES_AUDIO_PROCESSING_AEC3_RENDER_DELAY_BUFFER_BASE_H_
+#define MODULES_AUDIO_PROCESSING_AEC3_RENDER_DELAY_BUFFER_BASE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "apm_data_dumper.h"
+#include "downsampled_render_buffer.h"
+#include "echo_canceller3_config.h"
+#include "logging.h"
+#include "render_delay_buffer.h"
+
+namespace webrtc {
+
+// Buffering logic shared by the render delay buffers: jitter tracking, overrun
+// and underrun handling and delay alignment. The low rate render buffers that
+// the latency is measured on are kept here, and are filled by the derived
+// classes. The full band block buffer is tracked through its read and write
+// indices, which the derived classes apply to the buffers they keep. If a fine
+// down-sampling factor is given, a second low rate buffer covering the same
+// span of time is kept in lockstep with the first one.
+class RenderDelayBufferBase : public RenderDelayBuffer {
+ public:
+  ~RenderDelayBufferBase() override;
+
+  void Reset() override;
+  BufferingEvent Insert(
+      const std::vector<std::vector<std::vector<float>>>& block) override;
+  BufferingEvent PrepareCaptureProcessing() override;
+  void HandleSkippedCaptureProcessing() override;
+  bool AlignFromDelay(size_t delay) override;
+  void AlignFromExternalDelay() override;
+  size_t Delay() const override { return ComputeDelay(); }
+  size_t MaxDelay() const override {
+    return num_blocks_ - 1 - buffer_headroom_;
+  }
+
+  const DownsampledRenderBuffer& GetDownsampledRenderBuffer() const override {
+    return low_rate_;
+  }
+
+  const DownsampledRenderBuffer& GetFineDownsampledRenderBuffer()
+      const override {
+    return fine_down_sampling_factor_ > 0 ? fine_low_rate_ : low_rate_;
+  }
+
+  int BufferLatency() const;
+  void SetAudioBufferDelay(int delay_ms) override;
+  bool HasReceivedBufferDelay() override;
+
+ protected:
+  // A |fine_down_sampling_factor| of zero does not keep a second low rate
+  // buffer. The derived classes call Reset once they are constructed.
+  RenderDelayBufferBase(const EchoCanceller3Config& config,
+                        size_t fine_down_sampling_factor);
+
+  // Clears the low rate buffers, the block indices and the buffering
+  // statistics, and resets the buffer.
+  void ClearBuffering();
+
+  const EchoCanceller3Config& config() const { return config_; }
+  ApmDataDumper* data_dumper() const { return data_dumper_.get(); }
+  float render_linear_amplitude_gain() const {
+    return render_linear_amplitude_gain_;
+  }
+  size_t down_sampling_factor() const { return down_sampling_factor_; }
+  int sub_block_size() const { return sub_block_size_; }
+  int fine_sub_block_size() const { return fine_sub_block_size_; }
+  int num_blocks() const { return num_blocks_; }
+  DownsampledRenderBuffer* low_rate() { return &low_rate_; }
+  DownsampledRenderBuffer* fine_low_rate() { return &fine_low_rate_; }
+
+ private:
+  // Writes a new block at the block write index, after it has been
+  // incremented, and into the low rate buffers.
+  virtual void InsertBlock(
+      const std::vector<std::vector<std::vector<float>>>& block) = 0;
+
+  // Moves the full band buffers of the derived class to the block indices.
+  virtual void ApplyBlockIndices(int read, int write) = 0;
+
+  static int instance_count_;
+  std::unique_ptr<ApmDataDumper> data_dumper_;
+  const EchoCanceller3Config config_;
+  const bool update_capture_call_counter_on_skipped_blocks_;
+  const float render_linear_amplitude_gain_;
+  const rtc::LoggingSeverity delay_log_level_;
+  const size_t down_sampling_factor_;
+  const int sub_block_size_;
+  const int num_blocks_;
+  int blocks_read_ = 0;
+  int blocks_write_ = 0;
+  absl::optional<size_t> delay_;
+  DownsampledRenderBuffer low_rate_;
+  const size_t fine_down_sampling_factor_;
+  const int fine_sub_block_size_;
+  DownsampledRenderBuffer fine_low_rate_;
+  const int buffer_headroom_;
+  bool last_call_was_render_ = false;
+  int num_api_calls_in_a_row_ = 0;
+  int max_observed_jitter_ = 1;
+  int64_t capture_call_counter_ = 0;
+  int64_t render_call_counter_ = 0;
+  absl::optional<int> external_audio_buffer_delay_;
+  bool external_audio_buffer_delay_verified_after_reset_ = false;
+  size_t min_latency_blocks_ = 0;
+  size_t excess_render_detection_counter_ = 0;
+
+  int MapDelayToTotalDelay(size_t delay) const;
+  int ComputeDelay() const;
+  void ApplyTotalDelay(int delay);
+  bool DetectExcessRenderBlocks();
+  void IncrementWriteIndices();
+  void IncrementLowRateReadIndices();
+  void IncrementReadIndices();
+  bool RenderOverrun();
+  bool RenderUnderrun();
+};
+
+}  // namespace webrtc
+
+#endif  // MODULES_AUDIO_PROCESSING_AEC3_RENDER_DELAY_BUFFER_BASE_H_
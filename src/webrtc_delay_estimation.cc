@@ -2,12 +2,131 @@
 
 #include <algorithm>
 #include <iterator>
+#include <vector>
 
+#include "absl/types/optional.h"
+#include "aec3_common.h"
 #include "apm_data_dumper.h"
+#include "deinterleave.h"
+#include "delay_estimation_render_delay_buffer.h"
+#include "dispatch_table.h"
 #include "echo_path_delay_estimator.h"
-#include "render_delay_buffer.h"
+#include "fir_decimator.h"
+#include "gcc_phat_delay_estimator.h"
 
 namespace webrtc_delay_estimation {
+namespace {
+
+// Rate the estimator runs at. Inputs at higher rates are decimated to it.
+constexpr size_t kEstimationRateHz = 16000;
+
+// Length of each phase of the filter used when decimating the input.
+constexpr size_t kDecimatorTapsPerPhase = 24;
+
+// Creates the configuration supplied to the WebRTC algorithm.
+webrtc::EchoCanceller3Config CreateConfig(const Setting& setting) {
+  webrtc::EchoCanceller3Config config;
+  config.delay.down_sampling_factor = setting.down_sampling_factor;
+  config.delay.num_filters = setting.num_filters;
+  config.delay.fine_down_sampling_factor = setting.fine_down_sampling_factor;
+  config.delay.num_fine_filters = setting.num_fine_filters;
+  config.delay.steady_state_probe_interval_blocks =
+      setting.steady_state_probe_interval_blocks;
+  config.delay.num_filter_threads = setting.num_filter_threads;
+  config.delay.num_delay_candidates = setting.num_delay_candidates;
+  config.delay.use_fir_decimator = setting.use_fir_decimator;
+  return config;
+}
+
+// Throws if the two inputs cannot be compared against each other.
+void CheckCompatibility(const WavFileInfo& render, const WavFileInfo& capture) {
+  if (render.sample_rate != capture.sample_rate ||
+      render.num_channels != capture.num_channels)
+    throw new IncompatibleInputsError();
+}
+
+// Returns the factor that brings the sample rate down to the rate the
+// estimator runs at. Throws if the sample rate is not supported.
+size_t DecimationFactor(size_t sample_rate) {
+  if (sample_rate != 16000 && sample_rate != 32000 && sample_rate != 48000)
+    throw new UnsupportedSampleRateError();
+  return sample_rate / kEstimationRateHz;
+}
+
+// Returns the number of input frames that make up one block.
+size_t FramesPerBlock(size_t sample_rate) {
+  return webrtc::kBlockSize * DecimationFactor(sample_rate);
+}
+
+// Returns the number of blocks to process, honouring the duration limit.
+size_t NumBlocksToProcess(const WavFileInfo& render,
+                          const WavFileInfo& capture,
+                          const Setting& setting) {
+  const size_t frames_per_block = FramesPerBlock(render.sample_rate);
+
+  // Use the minimum of the frames as the base value
+  size_t num_frames = std::min(render.samples.size() / render.num_channels,
+                               capture.samples.size() / capture.num_channels);
+  size_t num_blocks = num_frames / frames_per_block;
+
+  // Limit the amount of audio to process if requested
+  if (setting.max_duration_seconds > 0.f) {
+    size_t max_frames = static_cast<size_t>(setting.max_duration_seconds *
+                                            render.sample_rate);
+    num_blocks = std::min(num_blocks, max_frames / frames_per_block);
+  }
+
+  return num_blocks;
+}
+
+// Returns the longest delay, in samples at the input sample rate, that the
+// matched filters can find.
+size_t MaxDelay(const Setting& setting, size_t sample_rate) {
+  return (webrtc::kMatchedFilterAlignmentShiftSizeSubBlocks *
+              setting.num_filters +
+          webrtc::kMatchedFilterWindowSizeSubBlocks) *
+         webrtc::kBlockSize * DecimationFactor(sample_rate);
+}
+
+// Averages the first |num_frames| frames of every channel into one signal.
+std::vector<float> DownMix(const WavFileInfo& info, size_t num_frames) {
+  std::vector<float> mono(num_frames);
+  const float scale = 1.f / info.num_channels;
+  for (size_t k = 0; k < num_frames; k++) {
+    const float* frame = &info.samples[k * info.num_channels];
+    float sum = 0.f;
+    for (size_t ch = 0; ch < info.num_channels; ch++)
+      sum += frame[ch];
+    mono[k] = sum * scale;
+  }
+  return mono;
+}
+
+// Estimates the delay over the whole input at once with GCC-PHAT.
+size_t EstimateDelayGccPhat(const WavFileInfo& render,
+                            const WavFileInfo& capture,
+                            const Setting& setting) {
+  const size_t num_frames = NumBlocksToProcess(render, capture, setting) *
+                            FramesPerBlock(render.sample_rate);
+
+  webrtc::GccPhatDelayEstimator estimator(
+      MaxDelay(setting, render.sample_rate));
+  auto delay = estimator.EstimateDelay(DownMix(render, num_frames),
+                                       DownMix(capture, num_frames));
+  if (!delay)
+    throw new NoEstimateAvailableError();
+
+  return *delay;
+}
+
+// Returns whether the estimate has been stable for long enough to stop.
+bool IsSettled(const DelayEstimate& estimate, const Setting& setting) {
+  return setting.stable_blocks_to_stop > 0 &&
+         estimate.quality == DelayEstimate::Quality::kRefined &&
+         estimate.blocks_since_last_change >= setting.stable_blocks_to_stop;
+}
+
+}  // namespace
 
 const char* NoEstimateAvailableError::what() const noexcept {
   return "The delay estimator was not able to come up with a viable delay "
@@ -19,81 +138,461 @@ const char* IncompatibleInputsError::what() const noexcept {
          "delay.";
 }
 
-size_t EstimateDelay(WavFileInfo& render,
-                     WavFileInfo& capture,
-                     Setting setting) {
-  using namespace webrtc;
+const char* UnsupportedSampleRateError::what() const noexcept {
+  return "The sample rate of the input is not supported. Only 16000, 32000 "
+         "and 48000 Hz are supported.";
+}
 
-  // Input sanity check
-  if (render.sample_rate != capture.sample_rate ||
-      render.num_channels != capture.num_channels)
-    throw new IncompatibleInputsError();
+class DelayEstimator::Impl {
+ public:
+  Impl(size_t sample_rate,
+       size_t num_render_channels,
+       size_t num_capture_channels,
+       Setting setting);
 
-  // Use the minimum of the samples as the base value
-  size_t band_size = render.sample_rate / 16000;
-  size_t num_samples = std::min(render.samples.size(), capture.samples.size());
+  bool PushRender(const float* samples, size_t num_samples);
+  bool PushCapture(const float* samples, size_t num_samples);
 
-  ApmDataDumper data_dumper(0);  // NOP data dumper
+  const absl::optional<webrtc::DelayEstimate>& estimate() const {
+    return estimate_;
+  }
 
-  EchoCanceller3Config config;  // configuration supplied to WebRTC algorithm
-  config.delay.down_sampling_factor = setting.down_sampling_factor;
-  config.delay.num_filters = setting.num_filters;
+  webrtc::ClockdriftDetector::Level clockdrift() const {
+    return estimator_.Clockdrift();
+  }
+
+  void GetCandidates(
+      std::vector<webrtc::MatchedFilterLagAggregator::Candidate>* candidates)
+      const {
+    estimator_.GetDelayCandidates(config_.delay.num_delay_candidates,
+                                  candidates);
+  }
+
+  size_t decimation_factor() const { return decimation_factor_; }
+
+  void Reset();
+
+ private:
+  // Splits an interleaved input block into the channels of |block|, decimating
+  // every channel to the estimation rate if needed.
+  void FormBlock(const float* interleaved,
+                 std::vector<std::vector<float>>* full_rate,
+                 std::vector<std::unique_ptr<webrtc::FirDecimator>>* decimators,
+                 std::vector<std::vector<float>>* block);
+
+  // Processes as many pairs of render and capture blocks as are available.
+  bool ProcessPendingBlocks();
+
+  // Processes one render block and one capture block.
+  bool ProcessBlock(const float* render, const float* capture);
+
+  webrtc::ApmDataDumper data_dumper_;  // NOP data dumper
+  webrtc::EchoCanceller3Config config_;
+  const webrtc::DispatchTable& dispatch_table_;
+  const size_t decimation_factor_;
+
+  // Number of interleaved samples making up one block of each signal
+  const size_t render_block_length_;
+  const size_t capture_block_length_;
+
+  // Input rate buffers [channel][sample], only used when decimating
+  std::vector<std::vector<float>> render_frames_;
+  std::vector<std::vector<float>> capture_frames_;
+
+  // Per-channel decimators, empty when the input is at the estimation rate
+  std::vector<std::unique_ptr<webrtc::FirDecimator>> render_decimators_;
+  std::vector<std::unique_ptr<webrtc::FirDecimator>> capture_decimators_;
 
   // render buffer [band][channel][sample]
-  std::vector<std::vector<std::vector<float>>> render_buffer(
-      band_size, std::vector<std::vector<float>>(
-                     render.num_channels, std::vector<float>(kBlockSize)));
+  std::vector<std::vector<std::vector<float>>> render_block_;
 
   // capture buffer [channel][sample]
-  std::vector<std::vector<float>> capture_buffer(
-      capture.num_channels, std::vector<float>(kBlockSize));
+  std::vector<std::vector<float>> capture_block_;
 
   // Render delay buffer required to create downsampled render buffer
-  std::unique_ptr<webrtc::RenderDelayBuffer> render_delay_buffer(
-      webrtc::RenderDelayBuffer::Create(config, render.sample_rate,
-                                        render.num_channels));
+  std::unique_ptr<webrtc::DelayEstimationRenderDelayBuffer>
+      render_delay_buffer_;
 
   // Actual estimator object
-  webrtc::EchoPathDelayEstimator estimator(&data_dumper, config,
-                                           capture.num_channels);
+  webrtc::EchoPathDelayEstimator estimator_;
+
+  // Samples that have not yet been paired with a block of the other signal
+  std::vector<float> pending_render_;
+  std::vector<float> pending_capture_;
+
+  size_t num_processed_blocks_ = 0;
+  absl::optional<webrtc::DelayEstimate> estimate_;
+};
+
+DelayEstimator::Impl::Impl(size_t sample_rate,
+                           size_t num_render_channels,
+                           size_t num_capture_channels,
+                           Setting setting)
+    : data_dumper_(0),
+      config_(CreateConfig(setting)),
+      dispatch_table_(webrtc::GetDispatchTable()),
+      decimation_factor_(DecimationFactor(sample_rate)),
+      render_block_length_(FramesPerBlock(sample_rate) * num_render_channels),
+      capture_block_length_(FramesPerBlock(sample_rate) *
+                            num_capture_channels),
+      render_block_(1,
+                    std::vector<std::vector<float>>(
+                        num_render_channels,
+                        std::vector<float>(webrtc::kBlockSize))),
+      capture_block_(num_capture_channels,
+                     std::vector<float>(webrtc::kBlockSize)),
+      render_delay_buffer_(new webrtc::DelayEstimationRenderDelayBuffer(
+          config_,
+          static_cast<int>(kEstimationRateHz),
+          num_render_channels)),
+      estimator_(&data_dumper_, config_, num_capture_channels) {
+  if (decimation_factor_ == 1)
+    return;
+
+  // Every channel is low-pass filtered with the same coefficients, so that the
+  // group delay of the filter cancels out between render and capture
+  const auto coefficients = webrtc::FirDecimator::LowPassCoefficients(
+      decimation_factor_, kDecimatorTapsPerPhase * decimation_factor_);
+
+  render_frames_.assign(num_render_channels,
+                        std::vector<float>(FramesPerBlock(sample_rate)));
+  capture_frames_.assign(num_capture_channels,
+                         std::vector<float>(FramesPerBlock(sample_rate)));
+  for (size_t ch = 0; ch < num_render_channels; ch++)
+    render_decimators_.emplace_back(new webrtc::FirDecimator(
+        dispatch_table_.optimization, decimation_factor_, coefficients));
+  for (size_t ch = 0; ch < num_capture_channels; ch++)
+    capture_decimators_.emplace_back(new webrtc::FirDecimator(
+        dispatch_table_.optimization, decimation_factor_, coefficients));
+}
+
+void DelayEstimator::Impl::Reset() {
+  for (auto& decimator : render_decimators_)
+    decimator->Reset();
+  for (auto& decimator : capture_decimators_)
+    decimator->Reset();
+  render_delay_buffer_->Clear();
+  estimator_.Reset(true);
+
+  // Clearing keeps the capacity of the vectors
+  pending_render_.clear();
+  pending_capture_.clear();
+
+  num_processed_blocks_ = 0;
+  estimate_ = absl::nullopt;
+}
+
+bool DelayEstimator::Impl::PushRender(const float* samples,
+                                      size_t num_samples) {
+  pending_render_.insert(pending_render_.end(), samples, samples + num_samples);
+  return ProcessPendingBlocks();
+}
 
-  auto render_iter = render.samples.begin();
-  auto capture_iter = capture.samples.begin();
+bool DelayEstimator::Impl::PushCapture(const float* samples,
+                                       size_t num_samples) {
+  pending_capture_.insert(pending_capture_.end(), samples,
+                          samples + num_samples);
+  return ProcessPendingBlocks();
+}
+
+bool DelayEstimator::Impl::ProcessPendingBlocks() {
+  size_t num_blocks = std::min(pending_render_.size() / render_block_length_,
+                               pending_capture_.size() / capture_block_length_);
+
+  bool updated = false;
+  for (size_t i = 0; i < num_blocks; i++)
+    updated |= ProcessBlock(&pending_render_[i * render_block_length_],
+                            &pending_capture_[i * capture_block_length_]);
+
+  // Drop the samples that were consumed, keeping only the unpaired tail
+  pending_render_.erase(
+      pending_render_.begin(),
+      std::next(pending_render_.begin(), num_blocks * render_block_length_));
+  pending_capture_.erase(
+      pending_capture_.begin(),
+      std::next(pending_capture_.begin(), num_blocks * capture_block_length_));
+
+  return updated;
+}
+
+bool DelayEstimator::Impl::ProcessBlock(const float* render,
+                                        const float* capture) {
+  // Split the interleaved frames into every channel of the blocks
+  FormBlock(render, &render_frames_, &render_decimators_, &render_block_[0]);
+  FormBlock(capture, &capture_frames_, &capture_decimators_, &capture_block_);
+
+  render_delay_buffer_->Insert(render_block_);
+
+  if (num_processed_blocks_ == 0)
+    render_delay_buffer_->Reset();
+
+  render_delay_buffer_->PrepareCaptureProcessing();
+  num_processed_blocks_++;
+
+  // Age the current estimate before looking for a new one
+  if (estimate_) {
+    estimate_->blocks_since_last_change++;
+    estimate_->blocks_since_last_update++;
+  }
+
+  // Try estimating the delay
+  auto maybe_estimated_delay = estimator_.EstimateDelay(
+      render_delay_buffer_->GetDownsampledRenderBuffer(),
+      render_delay_buffer_->GetFineDownsampledRenderBuffer(), capture_block_);
+
+  // Sometimes, there is a new updated value, sometimes, there isn't
+  if (!maybe_estimated_delay)
+    return false;
+
+  if (estimate_ && estimate_->delay == maybe_estimated_delay->delay)
+    maybe_estimated_delay->blocks_since_last_change =
+        estimate_->blocks_since_last_change;
+  estimate_ = maybe_estimated_delay;
+
+  return true;
+}
+
+void DelayEstimator::Impl::FormBlock(
+    const float* interleaved,
+    std::vector<std::vector<float>>* full_rate,
+    std::vector<std::unique_ptr<webrtc::FirDecimator>>* decimators,
+    std::vector<std::vector<float>>* block) {
+  if (decimators->empty()) {
+    dispatch_table_.deinterleave_block(interleaved, block);
+    return;
+  }
+
+  dispatch_table_.deinterleave_block(interleaved, full_rate);
+  for (size_t ch = 0; ch < block->size(); ch++)
+    (*decimators)[ch]->Decimate((*full_rate)[ch], (*block)[ch]);
+}
+
+DelayEstimator::DelayEstimator(size_t sample_rate,
+                               size_t num_render_channels,
+                               size_t num_capture_channels,
+                               Setting setting)
+    : impl_(new Impl(sample_rate,
+                     num_render_channels,
+                     num_capture_channels,
+                     setting)) {}
+
+DelayEstimator::~DelayEstimator() = default;
+
+bool DelayEstimator::PushRender(const float* samples, size_t num_samples) {
+  return impl_->PushRender(samples, num_samples);
+}
+
+bool DelayEstimator::PushCapture(const float* samples, size_t num_samples) {
+  return impl_->PushCapture(samples, num_samples);
+}
+
+bool DelayEstimator::HasEstimate() const {
+  return impl_->estimate().has_value();
+}
+
+DelayEstimate DelayEstimator::GetEstimate() const {
+  const auto& estimate = impl_->estimate();
+  if (!estimate)
+    throw new NoEstimateAvailableError();
+
+  DelayEstimate result;
+  result.delay = estimate->delay * impl_->decimation_factor();
+  result.quality = estimate->quality == webrtc::DelayEstimate::Quality::kRefined
+                       ? DelayEstimate::Quality::kRefined
+                       : DelayEstimate::Quality::kCoarse;
+  result.blocks_since_last_change = estimate->blocks_since_last_change;
+  return result;
+}
+
+std::vector<DelayCandidate> DelayEstimator::GetCandidates() const {
+  std::vector<webrtc::MatchedFilterLagAggregator::Candidate> candidates;
+  impl_->GetCandidates(&candidates);
 
-  // Loop through the entire sample to find the best delay value
-  absl::optional<webrtc::DelayEstimate> estimated_delay;
-  for (int i = 0; i < num_samples / kBlockSize; i++) {
-    auto render_end = std::next(render_iter, kBlockSize);
-    auto capture_end = std::next(capture_iter, kBlockSize);
+  std::vector<DelayCandidate> result;
+  result.reserve(candidates.size());
+  for (const auto& candidate : candidates) {
+    DelayCandidate delay_candidate;
+    delay_candidate.delay = candidate.lag * impl_->decimation_factor();
+    delay_candidate.votes = static_cast<size_t>(candidate.votes);
+    delay_candidate.accuracy = candidate.accuracy;
+    result.push_back(delay_candidate);
+  }
+  return result;
+}
+
+ClockdriftLevel DelayEstimator::GetClockdrift() const {
+  switch (impl_->clockdrift()) {
+    case webrtc::ClockdriftDetector::Level::kVerified:
+      return ClockdriftLevel::kVerified;
+    case webrtc::ClockdriftDetector::Level::kProbable:
+      return ClockdriftLevel::kProbable;
+    default:
+      return ClockdriftLevel::kNone;
+  }
+}
+
+void DelayEstimator::Reset() {
+  impl_->Reset();
+}
+
+class EstimatorContext::Impl {
+ public:
+  DelayEstimator& Acquire(size_t sample_rate,
+                          size_t num_render_channels,
+                          size_t num_capture_channels,
+                          const Setting& setting);
+
+ private:
+  // Returns whether the current estimator was created with these parameters.
+  bool Matches(size_t sample_rate,
+               size_t num_render_channels,
+               size_t num_capture_channels,
+               const Setting& setting) const;
+
+  size_t sample_rate_ = 0;
+  size_t num_render_channels_ = 0;
+  size_t num_capture_channels_ = 0;
+  Setting setting_;
+  std::unique_ptr<DelayEstimator> estimator_;
+};
+
+DelayEstimator& EstimatorContext::Impl::Acquire(size_t sample_rate,
+                                                size_t num_render_channels,
+                                                size_t num_capture_channels,
+                                                const Setting& setting) {
+  if (Matches(sample_rate, num_render_channels, num_capture_channels,
+              setting)) {
+    estimator_->Reset();
+    return *estimator_;
+  }
+
+  estimator_.reset(new DelayEstimator(sample_rate, num_render_channels,
+                                      num_capture_channels, setting));
+  sample_rate_ = sample_rate;
+  num_render_channels_ = num_render_channels;
+  num_capture_channels_ = num_capture_channels;
+  setting_ = setting;
+  return *estimator_;
+}
+
+bool EstimatorContext::Impl::Matches(size_t sample_rate,
+                                     size_t num_render_channels,
+                                     size_t num_capture_channels,
+                                     const Setting& setting) const {
+  // Only the fields that shape the estimator are compared, the others only
+  // affect how much of the input is processed
+  return estimator_ && sample_rate_ == sample_rate &&
+         num_render_channels_ == num_render_channels &&
+         num_capture_channels_ == num_capture_channels &&
+         setting_.down_sampling_factor == setting.down_sampling_factor &&
+         setting_.num_filters == setting.num_filters &&
+         setting_.fine_down_sampling_factor ==
+             setting.fine_down_sampling_factor &&
+         setting_.num_fine_filters == setting.num_fine_filters &&
+         setting_.steady_state_probe_interval_blocks ==
+             setting.steady_state_probe_interval_blocks &&
+         setting_.num_filter_threads == setting.num_filter_threads &&
+         setting_.num_delay_candidates == setting.num_delay_candidates &&
+         setting_.use_fir_decimator == setting.use_fir_decimator;
+}
+
+EstimatorContext::EstimatorContext() : impl_(new Impl()) {}
 
-    std::copy(render_iter, render_end, render_buffer[0][0].begin());
-    std::copy(capture_iter, capture_end, capture_buffer[0].begin());
+EstimatorContext::~EstimatorContext() = default;
 
-    render_delay_buffer->Insert(render_buffer);
+DelayEstimator& EstimatorContext::Acquire(size_t sample_rate,
+                                          size_t num_render_channels,
+                                          size_t num_capture_channels,
+                                          const Setting& setting) {
+  return impl_->Acquire(sample_rate, num_render_channels, num_capture_channels,
+                        setting);
+}
 
-    if (i == 0)
-      render_delay_buffer->Reset();
+size_t EstimateDelay(WavFileInfo& render,
+                     WavFileInfo& capture,
+                     Setting setting) {
+  EstimatorContext context;
+  return EstimateDelay(render, capture, setting, context);
+}
 
-    render_delay_buffer->PrepareCaptureProcessing();
+size_t EstimateDelay(WavFileInfo& render,
+                     WavFileInfo& capture,
+                     Setting setting,
+                     EstimatorContext& context) {
+  CheckCompatibility(render, capture);
+  if (setting.engine == Setting::Engine::kGccPhat)
+    return EstimateDelayGccPhat(render, capture, setting);
 
-    // Try estimating the delay
-    auto maybe_estimated_delay = estimator.EstimateDelay(
-        render_delay_buffer->GetDownsampledRenderBuffer(), capture_buffer);
+  size_t num_blocks = NumBlocksToProcess(render, capture, setting);
 
-    // Sometimes, there is a new updated value, sometimes, there isn't
-    if (maybe_estimated_delay)
-      estimated_delay = maybe_estimated_delay;
+  DelayEstimator& estimator =
+      context.Acquire(render.sample_rate, render.num_channels,
+                      capture.num_channels, setting);
 
-    // Update the iterators
-    render_iter = render_end;
-    capture_iter = capture_end;
+  // Feed both signals block by block so that nothing is left pending
+  const size_t frames_per_block = FramesPerBlock(render.sample_rate);
+  const size_t render_block_length = frames_per_block * render.num_channels;
+  const size_t capture_block_length = frames_per_block * capture.num_channels;
+  for (size_t i = 0; i < num_blocks; i++) {
+    estimator.PushRender(&render.samples[i * render_block_length],
+                         render_block_length);
+    estimator.PushCapture(&capture.samples[i * capture_block_length],
+                          capture_block_length);
+
+    // Stop early once the refined estimate has settled
+    if (estimator.HasEstimate() && IsSettled(estimator.GetEstimate(), setting))
+      break;
   }
 
   // If no estimates found, throw an error
-  if (!estimated_delay)
+  if (!estimator.HasEstimate())
     throw new NoEstimateAvailableError();
 
-  return estimated_delay->delay;
+  return estimator.GetEstimate().delay;
+}
+
+DelayTimeline EstimateDelayTimeline(WavFileInfo& render,
+                                    WavFileInfo& capture,
+                                    Setting setting) {
+  CheckCompatibility(render, capture);
+  size_t num_blocks = NumBlocksToProcess(render, capture, setting);
+
+  DelayEstimator estimator(render.sample_rate, render.num_channels,
+                           capture.num_channels, setting);
+
+  // Reserve room for an estimate from every block up front
+  DelayTimeline timeline;
+  timeline.block_index.reserve(num_blocks);
+  timeline.delay.reserve(num_blocks);
+  timeline.quality.reserve(num_blocks);
+  timeline.blocks_since_last_change.reserve(num_blocks);
+  timeline.clockdrift.reserve(num_blocks);
+
+  const size_t frames_per_block = FramesPerBlock(render.sample_rate);
+  const size_t render_block_length = frames_per_block * render.num_channels;
+  const size_t capture_block_length = frames_per_block * capture.num_channels;
+  for (size_t i = 0; i < num_blocks; i++) {
+    estimator.PushRender(&render.samples[i * render_block_length],
+                         render_block_length);
+    if (!estimator.PushCapture(&capture.samples[i * capture_block_length],
+                               capture_block_length))
+      continue;
+
+    // Record the estimate produced by this block
+    auto estimate = estimator.GetEstimate();
+    timeline.block_index.push_back(i);
+    timeline.delay.push_back(estimate.delay);
+    timeline.quality.push_back(estimate.quality);
+    timeline.blocks_since_last_change.push_back(
+        estimate.blocks_since_last_change);
+    timeline.clockdrift.push_back(estimator.GetClockdrift());
+
+    // Stop early once the refined estimate has settled
+    if (IsSettled(estimate, setting))
+      break;
+  }
+
+  return timeline;
 }
 
 }  // namespace webrtc_delay_estimation
@@ -0,0 +1,87 @@
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#include "aec3_common.h"
+#include "cascaded_biquad_filter.h"
+#include "decimator.h"
+
+#include "test_tools.h"
+
+TEST_CASE("optimized biquad cascade should match the generic implementation", "[decimation]") {
+  using namespace webrtc;
+
+  constexpr size_t kNumBiQuads[] = {1, 3, 4, 5, 8};
+  constexpr size_t kBlockSizes[] = {kBlockSize, 16, 4, 3};
+  constexpr size_t kDownSamplingFactors[] = {1, 3};
+  constexpr size_t kNumBlocks = 10;
+  const CascadedBiQuadFilter::ApplyBiQuadsFunction optimized_apply_biquads =
+      aec3::SelectApplyBiQuads(DetectOptimization());
+
+  for (auto num_biquads : kNumBiQuads) {
+    for (auto block_size : kBlockSizes) {
+      for (auto factor : kDownSamplingFactors) {
+        SECTION(std::to_string(num_biquads) + " biquads on blocks of " +
+                std::to_string(block_size) + " samples decimated by " +
+                std::to_string(factor)) {
+          // Stable biquads with their poles inside a circle of radius 0.9.
+          std::mt19937 gen(42);
+          std::uniform_real_distribution<float> dist(-0.6f, 0.6f);
+          std::vector<CascadedBiQuadFilter::BiQuadParam> params;
+          for (size_t i = 0; i < num_biquads; i++)
+            params.emplace_back(std::complex<float>(dist(gen), dist(gen)),
+                                std::complex<float>(dist(gen), dist(gen)),
+                                0.5f);
+          std::vector<CascadedBiQuadFilter::BiQuad> expected_biquads;
+          for (const auto& param : params)
+            expected_biquads.emplace_back(param);
+          std::vector<CascadedBiQuadFilter::BiQuad> actual_biquads =
+              expected_biquads;
+
+          // Scale the signal to [-1, 1] to keep the rounding errors small, and
+          // process several blocks to check that the states carry over.
+          std::vector<float> x(block_size * factor);
+          std::vector<float> expected(block_size);
+          std::vector<float> actual(block_size);
+          for (size_t block = 0; block < kNumBlocks; block++) {
+            RandomizeSampleVector(x);
+            for (auto& v : x)
+              v /= 32768.f;
+            aec3::ApplyBiQuads(expected_biquads, x, factor, expected);
+            optimized_apply_biquads(actual_biquads, x, factor, actual);
+            for (size_t k = 0; k < block_size; k++)
+              REQUIRE(actual[k] == Approx(expected[k]).margin(1e-5f));
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("optimized decimator should match the generic one", "[decimation]") {
+  using namespace webrtc;
+
+  constexpr size_t kDownSamplingFactors[] = {2, 4, 8};
+  constexpr size_t kNumBlocks = 20;
+
+  for (auto factor : kDownSamplingFactors) {
+    SECTION("the down sampling factor is " + std::to_string(factor)) {
+      Decimator expected_decimator(Aec3Optimization::kNone, factor, false);
+      Decimator actual_decimator(DetectOptimization(), factor, false);
+
+      std::vector<float> x(kBlockSize);
+      std::vector<float> expected(kBlockSize / factor);
+      std::vector<float> actual(kBlockSize / factor);
+      for (size_t block = 0; block < kNumBlocks; block++) {
+        RandomizeSampleVector(x);
+        expected_decimator.Decimate(x, expected);
+        actual_decimator.Decimate(x, actual);
+        for (size_t k = 0; k < expected.size(); k++)
+          REQUIRE(actual[k] == Approx(expected[k]).margin(1e-2f));
+      }
+    }
+  }
+}
@@ -0,0 +1,100 @@
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#include "aec3_common.h"
+#include "cpu_features_wrapper.h"
+#include "fir_decimator.h"
+
+#include "test_tools.h"
+
+TEST_CASE("optimized FIR decimation should match the generic implementation", "[decimation]") {
+  using namespace webrtc;
+
+  constexpr size_t kDownSamplingFactors[] = {2, 3};
+  constexpr size_t kNumTaps[] = {37, 48, 72};
+
+  for (auto factor : kDownSamplingFactors) {
+    for (auto num_taps : kNumTaps) {
+      SECTION("the down sampling factor is " + std::to_string(factor) +
+              " and the filter has " + std::to_string(num_taps) + " taps") {
+        // Scale both signals to [-1, 1] to keep the rounding errors small.
+        std::vector<float> h(num_taps);
+        RandomizeSampleVector(h);
+        for (auto& v : h)
+          v /= 32768.f;
+        std::vector<float> x(num_taps + kBlockSize * factor);
+        RandomizeSampleVector(x);
+        for (auto& v : x)
+          v /= 32768.f;
+
+        std::vector<float> expected(kBlockSize);
+        aec3::FirDecimateCore(factor, h, x.data(), expected);
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+        std::vector<float> actual(kBlockSize);
+        aec3::FirDecimateCore_SSE2(factor, h, x.data(), actual);
+        for (size_t k = 0; k < kBlockSize; k++)
+          REQUIRE(actual[k] == Approx(expected[k]).margin(1e-4f));
+
+        if (GetCPUInfo(kAVX2) != 0) {
+          aec3::FirDecimateCore_AVX2(factor, h, x.data(), actual);
+          for (size_t k = 0; k < kBlockSize; k++)
+            REQUIRE(actual[k] == Approx(expected[k]).margin(1e-4f));
+        }
+#endif
+      }
+    }
+  }
+}
+
+TEST_CASE("band-pass FIR coefficients should have linear phase and unity gain in the pass band", "[decimation]") {
+  using namespace webrtc;
+
+  constexpr size_t kNumTaps = 128;
+  constexpr double kLowCutoff = 0.0625;
+  constexpr double kHighCutoff = 0.125;
+  auto h = FirDecimator::BandPassCoefficients(kLowCutoff, kHighCutoff, kNumTaps);
+  REQUIRE(h.size() == kNumTaps);
+
+  // Symmetric coefficients give a linear phase.
+  for (size_t n = 0; n < kNumTaps; n++)
+    REQUIRE(h[n] == Approx(h[kNumTaps - 1 - n]).margin(1e-6f));
+
+  auto gain = [&](double frequency) {
+    constexpr double kPi = 3.14159265358979323846;
+    double real = 0.0;
+    double imag = 0.0;
+    for (size_t n = 0; n < kNumTaps; n++) {
+      real += h[n] * std::cos(2.0 * kPi * frequency * n);
+      imag -= h[n] * std::sin(2.0 * kPi * frequency * n);
+    }
+    return std::sqrt(real * real + imag * imag);
+  };
+
+  REQUIRE(gain(0.5 * (kLowCutoff + kHighCutoff)) == Approx(1.0).margin(1e-4));
+  REQUIRE(gain(0.0) < 1e-3);
+  REQUIRE(gain(0.25) < 1e-3);
+}
+
+TEST_CASE("FIR decimator should keep constant signal unchanged", "[decimation]") {
+  using namespace webrtc;
+
+  constexpr size_t kFactor = 3;
+  auto coefficients = FirDecimator::LowPassCoefficients(kFactor, 72);
+  REQUIRE(std::accumulate(coefficients.begin(), coefficients.end(), 0.f) ==
+          Approx(1.f));
+
+  FirDecimator decimator(DetectOptimization(), kFactor, coefficients);
+  std::vector<float> x(kBlockSize * kFactor, 1000.f);
+  std::vector<float> out(kBlockSize);
+
+  // Once the history is filled with the constant, so is the output.
+  decimator.Decimate(x, out);
+  decimator.Decimate(x, out);
+  for (auto sample : out)
+    REQUIRE(sample == Approx(1000.f));
+}
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#include "ooura_real_fft.h"
+#include "webrtc_delay_estimation.h"
+
+#include "test_tools.h"
+
+TEST_CASE("real FFT should match the discrete Fourier transform", "[gcc_phat]") {
+  using namespace webrtc;
+
+  constexpr size_t kFftSizes[] = {8, 16, 32, 128, 512, 2048};
+
+  for (auto fft_size : kFftSizes) {
+    SECTION("the FFT size is " + std::to_string(fft_size)) {
+      std::vector<float> x(fft_size);
+      RandomizeSampleVector(x);
+      for (auto& v : x)
+        v /= 32768.f;
+
+      OouraRealFft fft(fft_size);
+      std::vector<float> a = x;
+      fft.Fft(a.data());
+
+      // The imaginary parts are computed with a positive sine.
+      const double kPi = std::acos(-1.0);
+      for (size_t k = 0; k <= fft_size / 2; k++) {
+        double re = 0.0;
+        double im = 0.0;
+        for (size_t j = 0; j < fft_size; j++) {
+          double phase = 2.0 * kPi * ((j * k) % fft_size) / fft_size;
+          re += x[j] * std::cos(phase);
+          im += x[j] * std::sin(phase);
+        }
+
+        if (k == 0) {
+          REQUIRE(a[0] == Approx(re).margin(1e-3));
+        } else if (k == fft_size / 2) {
+          REQUIRE(a[1] == Approx(re).margin(1e-3));
+        } else {
+          REQUIRE(a[2 * k] == Approx(re).margin(1e-3));
+          REQUIRE(a[2 * k + 1] == Approx(im).margin(1e-3));
+        }
+      }
+
+      // The inverse transform scales the signal by half the FFT size.
+      fft.InverseFft(a.data());
+      for (size_t j = 0; j < fft_size; j++)
+        REQUIRE(a[j] * 2.f / fft_size == Approx(x[j]).margin(1e-4));
+    }
+  }
+}
+
+TEST_CASE("GCC-PHAT should produce the exact delay", "[gcc_phat]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr int kSampleRates[] = {16000, 48000};
+  constexpr size_t kSampleSize = 64000;
+  constexpr size_t kDelaySamples[] = {0, 3, 257, 4001};
+
+  std::vector<float> source(kSampleSize);
+  RandomizeSampleVector(source);
+
+  for (auto sample_rate : kSampleRates) {
+    for (auto delay : kDelaySamples) {
+      SECTION("the sample rate is " + std::to_string(sample_rate) +
+              " and the delay sample count is " + std::to_string(delay)) {
+        // The second channel carries the same signal at half the level
+        auto signals = MakeDelayedPair(source, delay, sample_rate, {1.f, 0.5f});
+
+        Setting setting;
+        setting.down_sampling_factor = 8;
+        setting.num_filters = 10;
+        setting.engine = Setting::Engine::kGccPhat;
+
+        REQUIRE(EstimateDelay(signals.render, signals.capture, setting) == delay);
+      }
+    }
+  }
+}
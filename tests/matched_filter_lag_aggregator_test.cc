@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#include "absl/types/optional.h"
+#include "apm_data_dumper.h"
+#include "delay_estimate.h"
+#include "echo_canceller3_config.h"
+#include "matched_filter.h"
+#include "matched_filter_lag_aggregator.h"
+
+namespace {
+
+// Aggregates the lag estimates by searching the whole histogram for its mode
+// on every call.
+class ReferenceLagAggregator {
+ public:
+  ReferenceLagAggregator(size_t max_filter_lag, int initial, int converged)
+      : histogram_(max_filter_lag + 1, 0),
+        initial_(initial),
+        converged_(converged) {
+    histogram_data_.fill(0);
+  }
+
+  void Reset() {
+    std::fill(histogram_.begin(), histogram_.end(), 0);
+    histogram_data_.fill(0);
+    histogram_data_index_ = 0;
+  }
+
+  absl::optional<webrtc::DelayEstimate> Aggregate(int lag) {
+    --histogram_[histogram_data_[histogram_data_index_]];
+    histogram_data_[histogram_data_index_] = lag;
+    ++histogram_[lag];
+    histogram_data_index_ =
+        (histogram_data_index_ + 1) % histogram_data_.size();
+
+    const int candidate =
+        std::distance(histogram_.begin(),
+                      std::max_element(histogram_.begin(), histogram_.end()));
+    significant_candidate_found_ =
+        significant_candidate_found_ || histogram_[candidate] > converged_;
+    if (histogram_[candidate] > converged_ ||
+        (histogram_[candidate] > initial_ && !significant_candidate_found_)) {
+      return webrtc::DelayEstimate(
+          significant_candidate_found_
+              ? webrtc::DelayEstimate::Quality::kRefined
+              : webrtc::DelayEstimate::Quality::kCoarse,
+          candidate);
+    }
+    return absl::nullopt;
+  }
+
+ private:
+  std::vector<int> histogram_;
+  std::array<int, 250> histogram_data_;
+  size_t histogram_data_index_ = 0;
+  bool significant_candidate_found_ = false;
+  const int initial_;
+  const int converged_;
+};
+
+}  // namespace
+
+TEST_CASE("lag aggregator should find the same mode as a full histogram search", "[lag_aggregator]") {
+  using namespace webrtc;
+
+  constexpr size_t kMaxFilterLag = 2000;
+  const EchoCanceller3Config::Delay::DelaySelectionThresholds kThresholds = {
+      5, 20};
+
+  ApmDataDumper data_dumper(0);
+  MatchedFilterLagAggregator aggregator(&data_dumper, kMaxFilterLag,
+                                        kThresholds, false);
+  ReferenceLagAggregator reference(kMaxFilterLag, kThresholds.initial,
+                                   kThresholds.converged);
+
+  // Vote mostly for a few lags next to each other, whose share changes over
+  // time, so that the mode moves and is often tied with other lags.
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> any_lag(0, kMaxFilterLag);
+  std::uniform_int_distribution<int> choice(0, 9);
+  constexpr int kLags[] = {700, 701, 702, 1400};
+
+  for (int block = 0; block < 5000; ++block) {
+    if (block == 2500) {
+      aggregator.Reset(false);
+      reference.Reset();
+    }
+
+    const int c = choice(gen);
+    const int lag =
+        c < 8 ? kLags[(c + block / 300) % 4] : any_lag(gen);
+    const std::array<MatchedFilter::LagEstimate, 1> lag_estimates = {
+        MatchedFilter::LagEstimate(1.f, true, lag, true)};
+
+    const auto expected = reference.Aggregate(lag);
+    const auto estimate = aggregator.Aggregate(lag_estimates);
+    REQUIRE(estimate.has_value() == expected.has_value());
+    if (expected) {
+      REQUIRE(estimate->delay == expected->delay);
+      REQUIRE(estimate->quality == expected->quality);
+    }
+  }
+}
@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#include "aec3_common.h"
+#include "apm_data_dumper.h"
+#include "cpu_features_wrapper.h"
+#include "downsampled_render_buffer.h"
+#include "matched_filter.h"
+
+#include "test_tools.h"
+
+TEST_CASE("optimized matched filter core should match the generic implementation", "[matched_filter]") {
+  using namespace webrtc;
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+  if (GetCPUInfo(kAVX512F) == 0)
+    return;
+
+  constexpr size_t kDownSamplingFactors[] = {2, 4, 8};
+
+  for (auto factor : kDownSamplingFactors) {
+    SECTION("the down sampling factor is " + std::to_string(factor)) {
+      const size_t sub_block_size = kBlockSize / factor;
+      const size_t h_size = kMatchedFilterWindowSizeSubBlocks * sub_block_size;
+
+      // Scale the signals to [-1, 1] to keep the rounding errors small, and
+      // start close to the end of the circular buffer so that the filter
+      // reads from its mirror.
+      const size_t x_size = GetDownSampledBufferSize(factor, 10);
+      std::vector<float> x(2 * x_size);
+      RandomizeSampleVector(x);
+      for (size_t k = 0; k < x_size; k++) {
+        x[k] /= 32768.f;
+        x[k + x_size] = x[k];
+      }
+      std::vector<float> y(sub_block_size);
+      RandomizeSampleVector(y);
+      for (auto& v : y)
+        v /= 32768.f;
+      const size_t x_start_index = x_size - h_size / 2 - 3;
+
+      std::vector<float> expected_h(h_size, 0.f);
+      bool expected_updated = false;
+      float expected_error_sum = 0.f;
+      aec3::MatchedFilterCore(x_start_index, 0.f, 0.7f, x, y, expected_h,
+                              &expected_updated, &expected_error_sum);
+
+      std::vector<float> h(h_size, 0.f);
+      bool updated = false;
+      float error_sum = 0.f;
+      aec3::MatchedFilterCore_AVX512(x_start_index, 0.f, 0.7f, x, y, h,
+                                     &updated, &error_sum);
+
+      REQUIRE(updated == expected_updated);
+      REQUIRE(error_sum == Approx(expected_error_sum).epsilon(1e-3));
+      for (size_t k = 0; k < h_size; k++)
+        REQUIRE(h[k] == Approx(expected_h[k]).margin(1e-4f));
+    }
+  }
+#endif
+}
+
+TEST_CASE("matched filter bank core should match applying every filter separately", "[matched_filter]") {
+  using namespace webrtc;
+
+  constexpr size_t kDownSamplingFactors[] = {2, 4, 8};
+  constexpr size_t kNumFilters = 10;
+
+  for (auto factor : kDownSamplingFactors) {
+    SECTION("the down sampling factor is " + std::to_string(factor)) {
+      const size_t sub_block_size = kBlockSize / factor;
+      const size_t h_size = kMatchedFilterWindowSizeSubBlocks * sub_block_size;
+      const size_t filter_shift =
+          kMatchedFilterAlignmentShiftSizeSubBlocks * sub_block_size;
+
+      // Start close to the end of the circular buffer so that the last filters
+      // read from its mirror.
+      const size_t x_size = GetDownSampledBufferSize(factor, kNumFilters);
+      std::vector<float> x(2 * x_size);
+      RandomizeSampleVector(x);
+      for (size_t k = 0; k < x_size; k++) {
+        x[k] /= 32768.f;
+        x[k + x_size] = x[k];
+      }
+      std::vector<float> y(sub_block_size);
+      RandomizeSampleVector(y);
+      for (auto& v : y)
+        v /= 32768.f;
+      const size_t x_start_index = x_size - h_size - 3;
+
+      std::vector<std::vector<float>> expected_h(
+          kNumFilters, std::vector<float>(h_size, 0.f));
+      bool expected_updated[kNumFilters] = {};
+      float expected_error_sums[kNumFilters] = {};
+      for (size_t n = 0; n < kNumFilters; n++) {
+        aec3::MatchedFilterCore(
+            (x_start_index + n * filter_shift) % x_size, 0.f, 0.7f, x, y,
+            expected_h[n], &expected_updated[n], &expected_error_sums[n]);
+      }
+
+      AlignedFilterCoefficients h(kNumFilters * h_size);
+      bool updated[kNumFilters] = {};
+      float error_sums[kNumFilters] = {};
+      float x2_sums[kNumFilters];
+      aec3::MatchedFilterBankCore(x_start_index, filter_shift, 0.f, 0.7f, x, y,
+                                  h.View(), updated, error_sums, x2_sums);
+
+      for (size_t n = 0; n < kNumFilters; n++) {
+        REQUIRE(updated[n] == expected_updated[n]);
+        REQUIRE(error_sums[n] ==
+                Approx(expected_error_sums[n]).epsilon(1e-3));
+        for (size_t k = 0; k < h_size; k++) {
+          REQUIRE(h.View()[n * h_size + k] ==
+                  Approx(expected_h[n][k]).margin(1e-4f));
+        }
+      }
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+      if (GetCPUInfo(kAVX2) != 0) {
+        AlignedFilterCoefficients avx2_h(kNumFilters * h_size);
+        bool avx2_updated[kNumFilters] = {};
+        float avx2_error_sums[kNumFilters] = {};
+        aec3::MatchedFilterBankCore_AVX2(x_start_index, filter_shift, 0.f,
+                                         0.7f, x, y, avx2_h.View(),
+                                         avx2_updated, avx2_error_sums,
+                                         x2_sums);
+
+        for (size_t n = 0; n < kNumFilters; n++) {
+          REQUIRE(avx2_updated[n] == expected_updated[n]);
+          REQUIRE(avx2_error_sums[n] ==
+                  Approx(expected_error_sums[n]).epsilon(1e-3));
+          for (size_t k = 0; k < h_size; k++) {
+            REQUIRE(avx2_h.View()[n * h_size + k] ==
+                    Approx(expected_h[n][k]).margin(1e-4f));
+          }
+        }
+      }
+#endif
+    }
+  }
+}
+
+TEST_CASE("specialized matched filter bank cores should match the run time sized ones", "[matched_filter]") {
+  using namespace webrtc;
+
+  constexpr size_t kDownSamplingFactors[] = {2, 4, 8};
+  constexpr size_t kNumFilters = 10;
+  const Aec3Optimization optimization = DetectOptimization();
+
+  for (auto factor : kDownSamplingFactors) {
+    SECTION("the down sampling factor is " + std::to_string(factor)) {
+      const size_t sub_block_size = kBlockSize / factor;
+      const size_t h_size = kMatchedFilterWindowSizeSubBlocks * sub_block_size;
+      const size_t filter_shift =
+          kMatchedFilterAlignmentShiftSizeSubBlocks * sub_block_size;
+
+      const aec3::MatchedFilterBankCoreFunction generic_core =
+          aec3::SelectMatchedFilterBankCore(optimization, 0, 0, 0);
+      const aec3::MatchedFilterBankCoreFunction specialized_core =
+          aec3::SelectMatchedFilterBankCore(optimization, sub_block_size,
+                                            h_size, filter_shift);
+      REQUIRE(specialized_core != generic_core);
+
+      const size_t x_size = GetDownSampledBufferSize(factor, kNumFilters);
+      std::vector<float> x(2 * x_size);
+      RandomizeSampleVector(x);
+      for (size_t k = 0; k < x_size; k++) {
+        x[k] /= 32768.f;
+        x[k + x_size] = x[k];
+      }
+      std::vector<float> y(sub_block_size);
+      RandomizeSampleVector(y);
+      for (auto& v : y)
+        v /= 32768.f;
+      const size_t x_start_index = x_size - h_size - 3;
+
+      AlignedFilterCoefficients expected_h(kNumFilters * h_size);
+      std::array<bool, kNumFilters> expected_updated = {};
+      std::array<float, kNumFilters> expected_error_sums = {};
+      std::array<float, kNumFilters> x2_sums;
+      generic_core(x_start_index, filter_shift, 0.f, 0.7f, x, y,
+                   expected_h.View(), expected_updated, expected_error_sums,
+                   x2_sums);
+
+      AlignedFilterCoefficients h(kNumFilters * h_size);
+      std::array<bool, kNumFilters> updated = {};
+      std::array<float, kNumFilters> error_sums = {};
+      specialized_core(x_start_index, filter_shift, 0.f, 0.7f, x, y, h.View(),
+                       updated, error_sums, x2_sums);
+
+      for (size_t n = 0; n < kNumFilters; n++) {
+        REQUIRE(updated[n] == expected_updated[n]);
+        REQUIRE(error_sums[n] ==
+                Approx(expected_error_sums[n]).epsilon(1e-3));
+        for (size_t k = 0; k < h_size; k++) {
+          REQUIRE(h.View()[n * h_size + k] ==
+                  Approx(expected_h.View()[n * h_size + k]).margin(1e-4f));
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("optimized peak search should find the same peak as the generic one", "[matched_filter]") {
+  using namespace webrtc;
+
+  constexpr size_t kFilterLengths[] = {64, 128, 256, 512, 1024};
+
+  for (auto h_size : kFilterLengths) {
+    SECTION("the filter length is " + std::to_string(h_size)) {
+      std::vector<float> h(h_size);
+      RandomizeSampleVector(h);
+      const size_t expected_peak = aec3::MaxSquarePeakIndex(h);
+
+      // A negative peak is found by its square, and the first of two equal
+      // peaks is kept.
+      std::vector<float> tied_h(h_size, 0.f);
+      tied_h[h_size / 2 + 3] = -1.f;
+      tied_h[h_size - 1] = 1.f;
+      REQUIRE(aec3::MaxSquarePeakIndex(tied_h) == h_size / 2 + 3);
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+      REQUIRE(aec3::MaxSquarePeakIndex_SSE2(h) == expected_peak);
+      REQUIRE(aec3::MaxSquarePeakIndex_SSE2(tied_h) == h_size / 2 + 3);
+      if (GetCPUInfo(kAVX2) != 0) {
+        REQUIRE(aec3::MaxSquarePeakIndex_AVX2(h) == expected_peak);
+        REQUIRE(aec3::MaxSquarePeakIndex_AVX2(tied_h) == h_size / 2 + 3);
+      }
+#endif
+    }
+  }
+}
+
+TEST_CASE("matched filter split between threads should match a single thread", "[matched_filter]") {
+  using namespace webrtc;
+
+  constexpr size_t kDownSamplingFactor = 4;
+  constexpr size_t kSubBlockSize = kBlockSize / kDownSamplingFactor;
+  constexpr int kNumFilters = 10;
+  constexpr size_t kNumThreads[] = {2, 3, 4};
+
+  for (auto num_threads : kNumThreads) {
+    SECTION("the number of threads is " + std::to_string(num_threads)) {
+      ApmDataDumper data_dumper(0);
+      MatchedFilter expected_filter(
+          &data_dumper, DetectOptimization(), kSubBlockSize,
+          kMatchedFilterWindowSizeSubBlocks, kNumFilters,
+          kMatchedFilterAlignmentShiftSizeSubBlocks, 150.f, 0.7f, 0.2f, 1);
+      MatchedFilter filter(&data_dumper, DetectOptimization(), kSubBlockSize,
+                           kMatchedFilterWindowSizeSubBlocks, kNumFilters,
+                           kMatchedFilterAlignmentShiftSizeSubBlocks, 150.f,
+                           0.7f, 0.2f, num_threads);
+
+      // The capture is the render delayed by a lag that two filters cover.
+      DownsampledRenderBuffer render_buffer(
+          GetDownSampledBufferSize(kDownSamplingFactor, kNumFilters));
+      RandomizeSampleVector(render_buffer.buffer);
+      std::copy(render_buffer.buffer.begin(),
+                render_buffer.buffer.begin() + render_buffer.size,
+                render_buffer.buffer.begin() + render_buffer.size);
+      const size_t lag =
+          4 * kMatchedFilterAlignmentShiftSizeSubBlocks * kSubBlockSize + 64;
+      std::vector<float> capture(kSubBlockSize);
+
+      // Update every filter, then a range that spans several threads, then
+      // one that fits in the part of a single thread.
+      const std::pair<size_t, size_t> kRanges[] = {
+          {0, kNumFilters}, {1, kNumFilters - 1}, {4, 5}};
+      for (int block = 0; block < 150; ++block) {
+        const auto range = kRanges[block % 3];
+        render_buffer.UpdateReadIndex(-static_cast<int>(kSubBlockSize));
+        const size_t x_index = render_buffer.read + kSubBlockSize - 1 + lag;
+        for (size_t k = 0; k < kSubBlockSize; ++k) {
+          capture[k] = render_buffer.buffer[(x_index - k) % render_buffer.size];
+        }
+        expected_filter.Update(render_buffer, capture, range.first,
+                               range.second);
+        filter.Update(render_buffer, capture, range.first, range.second);
+
+        // The accuracy is the difference between the energy of the capture and
+        // the error, so its rounding error scales with the former.
+        const float capture_energy = std::inner_product(
+            capture.begin(), capture.end(), capture.begin(), 0.f);
+        const auto expected = expected_filter.GetLagEstimates();
+        const auto estimates = filter.GetLagEstimates();
+        for (size_t n = 0; n < kNumFilters; ++n) {
+          REQUIRE(estimates[n].updated == expected[n].updated);
+          REQUIRE(estimates[n].reliable == expected[n].reliable);
+          REQUIRE(estimates[n].accuracy ==
+                  Approx(expected[n].accuracy).margin(1e-4f * capture_energy));
+
+          // The filters only share work with the filters that they are
+          // updated with, so the rounding differs between the threads. This
+          // only moves the peaks of the filters that do not find the lag.
+          if (expected[n].reliable) {
+            REQUIRE(estimates[n].lag == expected[n].lag);
+          }
+        }
+      }
+      REQUIRE(filter.GetLagEstimates()[4].reliable);
+      REQUIRE(filter.GetLagEstimates()[4].lag == lag);
+    }
+  }
+}
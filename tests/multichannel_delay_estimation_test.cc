@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#include "aec3_common.h"
+#include "cpu_features_wrapper.h"
+#include "deinterleave.h"
+
+#include "webrtc_delay_estimation.h"
+
+#include "test_tools.h"
+
+TEST_CASE("optimized deinterleaving should match the generic implementation", "[deinterleave]") {
+  using namespace webrtc;
+
+  for (size_t num_channels = 1; num_channels <= 8; num_channels++) {
+    SECTION("the number of channels is " + std::to_string(num_channels)) {
+      std::vector<float> interleaved(kBlockSize * num_channels);
+      RandomizeSampleVector(interleaved);
+
+      std::vector<std::vector<float>> expected(
+          num_channels, std::vector<float>(kBlockSize));
+      DeinterleaveBlock(interleaved.data(), &expected);
+      for (size_t ch = 0; ch < num_channels; ch++)
+        for (size_t k = 0; k < kBlockSize; k++)
+          REQUIRE(expected[ch][k] == interleaved[k * num_channels + ch]);
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+      std::vector<std::vector<float>> actual(
+          num_channels, std::vector<float>(kBlockSize));
+      DeinterleaveBlock_SSE2(interleaved.data(), &actual);
+      REQUIRE(actual == expected);
+
+      if (GetCPUInfo(kAVX2) != 0) {
+        std::fill(actual.begin(), actual.end(),
+                  std::vector<float>(kBlockSize));
+        DeinterleaveBlock_AVX2(interleaved.data(), &actual);
+        REQUIRE(actual == expected);
+      }
+#endif
+    }
+  }
+}
+
+TEST_CASE("multichannel samples should produce correct delay", "[delay_estimation]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr int kSampleRateHz = 16000;
+  constexpr size_t kNumFrames = 32000;
+  constexpr size_t kDelayFrames = 300;
+
+  constexpr size_t kNumChannels[] = {2, 4};
+
+  for (auto num_channels : kNumChannels) {
+    SECTION("the number of channels is " + std::to_string(num_channels)) {
+      // Both sides pick the channel they align on by energy, so every render
+      // channel carries the same source at a different level
+      std::vector<float> source(kNumFrames);
+      RandomizeSampleVector(source);
+      std::vector<float> gains(num_channels);
+      for (size_t ch = 0; ch < num_channels; ch++)
+        gains[ch] = 1.f / (ch + 1);
+
+      // Delay every channel of the render signal by the same number of frames
+      auto signals = MakeDelayedPair(source, kDelayFrames, kSampleRateHz, gains);
+
+      Setting setting;
+      setting.down_sampling_factor = 4;
+      setting.num_filters = 10;
+
+      size_t result = EstimateDelay(signals.render, signals.capture, setting);
+
+      // Allow estimated delay to be off by one sample in the down-sampled domain.
+      size_t delay_ds = kDelayFrames / setting.down_sampling_factor;
+      size_t estimated_delay_ds = result / setting.down_sampling_factor;
+      REQUIRE(estimated_delay_ds >= delay_ds - 1);
+      REQUIRE(estimated_delay_ds <= delay_ds + 1);
+    }
+  }
+}
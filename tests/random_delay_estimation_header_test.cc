@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <cstddef>
+#include <string>
 #include <vector>
 
 #include "catch2/catch.hpp"
@@ -11,13 +12,13 @@
 TEST_CASE("sample vector filled with random sample should produce correct delay", "[delay_estimation]") {
   using namespace webrtc_delay_estimation;
 
-  constexpr size_t kNumRenderChannels = 1;
-  constexpr size_t kNumCaptureChannels = 1;
   constexpr int kSampleRateHz = 48000;
-  constexpr size_t kSampleSize = 15000;
+  constexpr size_t kSampleSize = 45000;
 
   constexpr size_t kDownSamplingFactors[] = {2, 4, 8};
-  constexpr size_t kDelaySamples[] = {30, 64, 150, 200, 800, 4000};
+  // Delays of only a few samples at 16 kHz are too short to be resolved once
+  // the input has been decimated.
+  constexpr size_t kDelaySamples[] = {96, 150, 200, 800, 4000};
 
   std::vector<float> render(kSampleSize);
   RandomizeSampleVector(render);
@@ -32,33 +33,22 @@ TEST_CASE("sample vector filled with random sample should produce correct delay"
       SECTION("the down sampling factor is " +
               std::to_string(ds_factor) +
               " and the delay sample count is " + std::to_string(delay)) {
-        
         // Create capture vector and copy the render buffer with delay
-        std::vector<float> capture(kSampleSize + delay);
-        std::fill(capture.begin(), std::next(capture.begin(), delay), 0.0f);
-        std::copy(render.begin(), render.end(), std::next(capture.begin(), delay));
-
-        // Construct WAV info structure
-        WavFileInfo render_info;
-        render_info.num_channels = kNumRenderChannels;
-        render_info.sample_rate = kSampleRateHz;
-        render_info.samples = render;
-        WavFileInfo capture_info;
-        capture_info.num_channels = kNumCaptureChannels;
-        capture_info.sample_rate = kSampleRateHz;
-        capture_info.samples = capture;
-        
+        auto signals = MakeDelayedPair(render, delay, kSampleRateHz);
+
         // Call delay estimator
         size_t result;
         try {
-          result = EstimateDelay(render_info, capture_info, setting);
+          result = EstimateDelay(signals.render, signals.capture, setting);
         } catch (std::exception e) {
           FAIL("Unable to get estimated delay value: " << e.what());
         }
 
         // Allow estimated delay to be off by one sample in the down-sampled domain.
-        size_t delay_ds = delay / ds_factor;
-        size_t estimated_delay_ds = result / ds_factor;
+        // The input is decimated to 16 kHz before down-sampling.
+        size_t ds_step = ds_factor * (kSampleRateHz / 16000);
+        size_t delay_ds = delay / ds_step;
+        size_t estimated_delay_ds = result / ds_step;
         REQUIRE(estimated_delay_ds >= delay_ds - 1);
         REQUIRE(estimated_delay_ds <= delay_ds + 1);
       }
@@ -66,3 +56,328 @@ TEST_CASE("sample vector filled with random sample should produce correct delay"
   }
 }
 
+
+TEST_CASE("early exit should produce the same delay as processing the entire input", "[delay_estimation]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr int kSampleRateHz = 16000;
+  constexpr size_t kSampleSize = 160000;
+  constexpr size_t kDelay = 800;
+  constexpr size_t kNumBlocks = kSampleSize / 64;
+
+  std::vector<float> render(kSampleSize);
+  RandomizeSampleVector(render);
+  auto signals = MakeDelayedPair(render, kDelay, kSampleRateHz);
+
+  Setting setting;
+  setting.down_sampling_factor = 4;
+  setting.num_filters = 10;
+  size_t full_result = EstimateDelay(signals.render, signals.capture, setting);
+
+  SECTION("stopping once the refined estimate is stable") {
+    setting.stable_blocks_to_stop = 250;
+    REQUIRE(EstimateDelay(signals.render, signals.capture, setting) == full_result);
+
+    // The estimate settles within the first few seconds of the ten
+    auto timeline = EstimateDelayTimeline(signals.render, signals.capture, setting);
+    REQUIRE(timeline.size() > 0);
+    REQUIRE(timeline.block_index.back() < kNumBlocks / 2);
+  }
+
+  SECTION("capping the processed duration") {
+    setting.max_duration_seconds = 3.f;
+    REQUIRE(EstimateDelay(signals.render, signals.capture, setting) == full_result);
+
+    auto timeline = EstimateDelayTimeline(signals.render, signals.capture, setting);
+    REQUIRE(timeline.size() > 0);
+    REQUIRE(timeline.block_index.back() < 3 * kSampleRateHz / 64);
+  }
+}
+
+TEST_CASE("early exit should wait for the two-stage search to refine the delay", "[delay_estimation]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr int kSampleRateHz = 16000;
+  constexpr size_t kSampleSize = 80000;
+  constexpr size_t kFineDownSamplingFactor = 2;
+  constexpr size_t kDelaySamples[] = {803, 3005};
+  constexpr size_t kStableBlocks[] = {10, 50};
+
+  std::vector<float> render(kSampleSize);
+  RandomizeSampleVector(render);
+
+  for (auto delay : kDelaySamples) {
+    for (auto stable_blocks : kStableBlocks) {
+      SECTION("the delay sample count is " + std::to_string(delay) +
+              " and the stable block count is " + std::to_string(stable_blocks)) {
+        auto signals = MakeDelayedPair(render, delay, kSampleRateHz);
+
+        Setting setting;
+        setting.down_sampling_factor = 8;
+        setting.num_filters = 10;
+        setting.fine_down_sampling_factor = kFineDownSamplingFactor;
+        setting.stable_blocks_to_stop = stable_blocks;
+
+        // The first stage estimate is only a multiple of 8 samples, so stopping
+        // on it would be off by several samples of the fine stage
+        auto timeline = EstimateDelayTimeline(signals.render, signals.capture, setting);
+        REQUIRE(timeline.size() > 0);
+        REQUIRE(timeline.quality.back() == DelayEstimate::Quality::kRefined);
+
+        size_t result = EstimateDelay(signals.render, signals.capture, setting);
+        REQUIRE(result == timeline.delay.back());
+        REQUIRE(result + kFineDownSamplingFactor >= delay);
+        REQUIRE(result <= delay + kFineDownSamplingFactor);
+      }
+    }
+  }
+}
+
+TEST_CASE("delay timeline should end with the same delay as the final estimate", "[delay_estimation]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr int kSampleRateHz = 16000;
+  constexpr size_t kSampleSize = 48000;
+  constexpr size_t kDelay = 400;
+
+  std::vector<float> render(kSampleSize);
+  RandomizeSampleVector(render);
+  auto signals = MakeDelayedPair(render, kDelay, kSampleRateHz);
+
+  Setting setting;
+  setting.down_sampling_factor = 4;
+  setting.num_filters = 10;
+
+  auto timeline = EstimateDelayTimeline(signals.render, signals.capture, setting);
+  REQUIRE(timeline.size() > 0);
+  REQUIRE(timeline.delay.size() == timeline.size());
+  REQUIRE(timeline.quality.size() == timeline.size());
+  REQUIRE(timeline.blocks_since_last_change.size() == timeline.size());
+  REQUIRE(timeline.clockdrift.size() == timeline.size());
+  REQUIRE(std::is_sorted(timeline.block_index.begin(), timeline.block_index.end()));
+
+  REQUIRE(timeline.delay.back() == EstimateDelay(signals.render, signals.capture, setting));
+  REQUIRE(timeline.quality.back() == DelayEstimate::Quality::kRefined);
+}
+
+TEST_CASE("two-stage search should produce delay at the fine down sampling factor", "[delay_estimation]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr int kSampleRateHz = 16000;
+  constexpr size_t kSampleSize = 80000;
+  constexpr size_t kFineDownSamplingFactor = 2;
+
+  constexpr size_t kDelaySamples[] = {201, 803, 3005};
+
+  std::vector<float> render(kSampleSize);
+  RandomizeSampleVector(render);
+
+  for (auto delay : kDelaySamples) {
+    SECTION("the delay sample count is " + std::to_string(delay)) {
+      auto signals = MakeDelayedPair(render, delay, kSampleRateHz);
+
+      Setting setting;
+      setting.down_sampling_factor = 8;
+      setting.num_filters = 10;
+      setting.fine_down_sampling_factor = kFineDownSamplingFactor;
+
+      size_t result = EstimateDelay(signals.render, signals.capture, setting);
+
+      // Allow estimated delay to be off by one sample in the finely down-sampled domain.
+      size_t delay_ds = delay / kFineDownSamplingFactor;
+      size_t estimated_delay_ds = result / kFineDownSamplingFactor;
+      REQUIRE(estimated_delay_ds >= delay_ds - 1);
+      REQUIRE(estimated_delay_ds <= delay_ds + 1);
+    }
+  }
+}
+
+TEST_CASE("delays longer than a second should be found with enough filters", "[delay_estimation]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr int kSampleRateHz = 16000;
+  constexpr size_t kSampleSize = 64000;
+  constexpr size_t kDelay = 24000;
+
+  std::vector<float> render(kSampleSize);
+  RandomizeSampleVector(render);
+  auto signals = MakeDelayedPair(render, kDelay, kSampleRateHz);
+
+  // Every filter covers another 12 ms of delay at a down sampling factor of 8
+  Setting setting;
+  setting.down_sampling_factor = 8;
+  setting.num_filters = 150;
+
+  size_t result = EstimateDelay(signals.render, signals.capture, setting);
+
+  // Allow estimated delay to be off by one sample in the down-sampled domain.
+  size_t delay_ds = kDelay / setting.down_sampling_factor;
+  size_t estimated_delay_ds = result / setting.down_sampling_factor;
+  REQUIRE(estimated_delay_ds >= delay_ds - 1);
+  REQUIRE(estimated_delay_ds <= delay_ds + 1);
+}
+
+TEST_CASE("reused context should produce the same delays as fresh estimators", "[delay_estimation]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr size_t kNumChannels = 2;
+  constexpr int kSampleRateHz = 48000;
+  constexpr size_t kSampleSize = 48000;
+  constexpr size_t kDelaySamples[] = {4000, 600, 4000};
+
+  Setting setting;
+  setting.down_sampling_factor = 8;
+  setting.num_filters = 10;
+  setting.fine_down_sampling_factor = 2;
+
+  // Each clip is only recorded on one of the channels, so that the render and
+  // capture mixers have to pick a channel again for every clip.
+  EstimatorContext context;
+  size_t channel = 0;
+  for (auto delay : kDelaySamples) {
+    std::vector<float> source(kSampleSize);
+    RandomizeSampleVector(source);
+
+    std::vector<float> gains(kNumChannels, 0.f);
+    gains[channel] = 1.f;
+    auto signals = MakeDelayedPair(source, delay, kSampleRateHz, gains);
+    channel = (channel + 1) % kNumChannels;
+
+    size_t expected = EstimateDelay(signals.render, signals.capture, setting);
+    REQUIRE(EstimateDelay(signals.render, signals.capture, setting, context) ==
+            expected);
+  }
+}
+
+TEST_CASE("steady state updates should still follow a change of the delay", "[delay_estimation]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr size_t kNumChannels = 1;
+  constexpr int kSampleRateHz = 16000;
+  constexpr size_t kSampleSize = 10 * kSampleRateHz;
+  constexpr size_t kDelays[] = {400, 3000};
+
+  std::vector<float> render(kSampleSize);
+  RandomizeSampleVector(render);
+
+  // The delay changes halfway through the input
+  std::vector<float> capture(kSampleSize, 0.0f);
+  for (size_t i = 0; i < kSampleSize; i++) {
+    const size_t delay = kDelays[i < kSampleSize / 2 ? 0 : 1];
+    if (i >= delay)
+      capture[i] = render[i - delay];
+  }
+
+  auto render_info = MakeWavFileInfo(render, kNumChannels, kSampleRateHz);
+  auto capture_info = MakeWavFileInfo(capture, kNumChannels, kSampleRateHz);
+
+  Setting setting;
+  setting.down_sampling_factor = 4;
+  setting.num_filters = 10;
+  setting.steady_state_probe_interval_blocks = 10;
+
+  auto timeline = EstimateDelayTimeline(render_info, capture_info, setting);
+  REQUIRE(timeline.size() > 0);
+
+  // Both delays should be found, to a sample in the down-sampled domain
+  constexpr size_t kBlocksPerHalf = kSampleSize / 2 / 64;
+  for (size_t k = 0; k < 2; k++) {
+    auto it = std::find_if(timeline.block_index.begin(), timeline.block_index.end(),
+                           [&](size_t block) { return block >= (k + 1) * kBlocksPerHalf; });
+    REQUIRE(it != timeline.block_index.begin());
+    const size_t i = std::distance(timeline.block_index.begin(), it) - 1;
+    const size_t delay_ds = kDelays[k] / setting.down_sampling_factor;
+    const size_t estimated_delay_ds = timeline.delay[i] / setting.down_sampling_factor;
+    REQUIRE(timeline.quality[i] == DelayEstimate::Quality::kRefined);
+    REQUIRE(estimated_delay_ds >= delay_ds - 1);
+    REQUIRE(estimated_delay_ds <= delay_ds + 1);
+  }
+}
+
+TEST_CASE("delay candidates should include every echo path", "[delay_estimation]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr size_t kNumChannels = 1;
+  constexpr int kSampleRateHz = 16000;
+  constexpr size_t kSampleSize = 4 * kSampleRateHz;
+  constexpr size_t kChunkSize = 160;
+  constexpr size_t kDelays[] = {800, 3200};
+  constexpr float kGains[] = {1.f, 0.6f};
+  constexpr unsigned int kSeed = 22;
+
+  std::vector<float> render(kSampleSize);
+  RandomizeSampleVector(render, kSeed);
+
+  // The capture signal is the sum of two echoes, which are covered by
+  // different filters.
+  std::vector<float> capture(kSampleSize, 0.0f);
+  for (size_t k = 0; k < 2; k++) {
+    for (size_t i = kDelays[k]; i < kSampleSize; i++)
+      capture[i] += kGains[k] * render[i - kDelays[k]];
+  }
+
+  Setting setting;
+  setting.down_sampling_factor = 4;
+  setting.num_filters = 10;
+  setting.num_delay_candidates = 4;
+
+  DelayEstimator estimator(kSampleRateHz, kNumChannels, kNumChannels, setting);
+  for (size_t i = 0; i < kSampleSize; i += kChunkSize) {
+    estimator.PushRender(&render[i], kChunkSize);
+    estimator.PushCapture(&capture[i], kChunkSize);
+  }
+
+  // Lags that a filter only found by chance are left out
+  auto candidates = estimator.GetCandidates();
+  REQUIRE(candidates.size() == 2);
+  REQUIRE(candidates[0].votes >= candidates[1].votes);
+
+  // Both delays should be found, to a sample in the down-sampled domain
+  for (auto delay : kDelays) {
+    auto it = std::find_if(
+        candidates.begin(), candidates.end(), [&](const DelayCandidate& c) {
+          return c.delay + setting.down_sampling_factor >= delay &&
+                 c.delay <= delay + setting.down_sampling_factor;
+        });
+    REQUIRE(it != candidates.end());
+    REQUIRE(it->accuracy > 0.f);
+    REQUIRE(it->accuracy <= 1.f);
+  }
+
+  // Without any candidates requested, none are tracked
+  setting.num_delay_candidates = 0;
+  DelayEstimator disabled(kSampleRateHz, kNumChannels, kNumChannels, setting);
+  disabled.PushRender(render.data(), kSampleSize);
+  disabled.PushCapture(capture.data(), kSampleSize);
+  REQUIRE(disabled.GetCandidates().empty());
+}
+
+TEST_CASE("FIR decimators should produce the same delay as the biquads", "[delay_estimation]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr int kSampleRateHz = 16000;
+  constexpr size_t kSampleSize = 3 * kSampleRateHz;
+  constexpr size_t kDelay = 2000;
+  constexpr size_t kDownSamplingFactors[] = {2, 4, 8};
+
+  std::vector<float> render(kSampleSize);
+  RandomizeSampleVector(render);
+  auto signals = MakeDelayedPair(render, kDelay, kSampleRateHz);
+
+  for (auto factor : kDownSamplingFactors) {
+    SECTION("the down sampling factor is " + std::to_string(factor)) {
+      Setting setting;
+      setting.down_sampling_factor = factor;
+      setting.num_filters = 10;
+      const size_t expected = EstimateDelay(signals.render, signals.capture, setting);
+
+      // Both signals go through the same filter, so that its delay cancels
+      // out.
+      setting.use_fir_decimator = true;
+      const size_t result = EstimateDelay(signals.render, signals.capture, setting);
+      REQUIRE(result == expected);
+      REQUIRE(result + factor >= kDelay);
+      REQUIRE(result <= kDelay + factor);
+    }
+  }
+}
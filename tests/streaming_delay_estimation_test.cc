@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#include "webrtc_delay_estimation.h"
+
+#include "test_tools.h"
+
+TEST_CASE("samples pushed in chunks of arbitrary size should produce correct delay", "[delay_estimation]") {
+  using namespace webrtc_delay_estimation;
+
+  constexpr size_t kNumChannels = 1;
+  constexpr int kSampleRateHz = 16000;
+  constexpr size_t kSampleSize = 40000;
+  constexpr size_t kMaxChunkSize = 500;
+
+  constexpr size_t kDownSamplingFactors[] = {2, 4, 8};
+  constexpr size_t kDelaySamples[] = {64, 200, 800};
+
+  std::vector<float> render(kSampleSize);
+  RandomizeSampleVector(render);
+
+  for (auto ds_factor : kDownSamplingFactors) {
+    Setting setting;
+    setting.down_sampling_factor = ds_factor;
+    setting.num_filters = 10;
+
+    for (auto delay : kDelaySamples) {
+      SECTION("the down sampling factor is " +
+              std::to_string(ds_factor) +
+              " and the delay sample count is " + std::to_string(delay)) {
+
+        // Create capture vector and copy the render buffer with delay
+        std::vector<float> capture(kSampleSize + delay);
+        std::fill(capture.begin(), std::next(capture.begin(), delay), 0.0f);
+        std::copy(render.begin(), render.end(), std::next(capture.begin(), delay));
+
+        DelayEstimator estimator(kSampleRateHz, kNumChannels, kNumChannels,
+                                 setting);
+        REQUIRE_FALSE(estimator.HasEstimate());
+
+        // Push both signals in independently sized chunks
+        std::mt19937 gen(ds_factor + delay);
+        std::uniform_int_distribution<size_t> chunk_size(1, kMaxChunkSize);
+        size_t render_pos = 0;
+        size_t capture_pos = 0;
+        while (render_pos < kSampleSize || capture_pos < kSampleSize) {
+          size_t render_chunk = std::min(chunk_size(gen), kSampleSize - render_pos);
+          estimator.PushRender(render.data() + render_pos, render_chunk);
+          render_pos += render_chunk;
+
+          size_t capture_chunk = std::min(chunk_size(gen), kSampleSize - capture_pos);
+          estimator.PushCapture(capture.data() + capture_pos, capture_chunk);
+          capture_pos += capture_chunk;
+        }
+
+        REQUIRE(estimator.HasEstimate());
+        auto estimate = estimator.GetEstimate();
+
+        // Allow estimated delay to be off by one sample in the down-sampled domain.
+        size_t delay_ds = delay / ds_factor;
+        size_t estimated_delay_ds = estimate.delay / ds_factor;
+        REQUIRE(estimated_delay_ds >= delay_ds - 1);
+        REQUIRE(estimated_delay_ds <= delay_ds + 1);
+        REQUIRE(estimate.quality == DelayEstimate::Quality::kRefined);
+      }
+    }
+  }
+}
@@ -1,8 +1,12 @@
 #include "test_tools.h"
 
+#include <algorithm>
 #include <cassert>
 #include <memory>
 #include <random>
+#include <utility>
+
+#include "matched_filter.h"
 
 void RandomizeSampleVector(rtc::ArrayView<float> samples) {
   constexpr float amplitude = 32767.0f;
@@ -15,6 +19,43 @@ void RandomizeSampleVector(rtc::ArrayView<float> samples) {
     sample = dist(gen);
 }
 
+void RandomizeSampleVector(rtc::ArrayView<float> samples, unsigned int seed) {
+  constexpr float amplitude = 32767.0f;
+
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> dist(-amplitude, amplitude);
+
+  for (auto& sample : samples)
+    sample = dist(gen);
+}
+
+webrtc_delay_estimation::WavFileInfo MakeWavFileInfo(std::vector<float> samples,
+                                                     size_t num_channels,
+                                                     int sample_rate) {
+  webrtc_delay_estimation::WavFileInfo info;
+  info.num_channels = num_channels;
+  info.sample_rate = sample_rate;
+  info.samples = std::move(samples);
+  return info;
+}
+
+DelayedPair MakeDelayedPair(const std::vector<float>& source,
+                            size_t delay,
+                            int sample_rate,
+                            const std::vector<float>& channel_gains) {
+  const size_t num_channels = channel_gains.size();
+  std::vector<float> render(source.size() * num_channels);
+  for (size_t k = 0; k < source.size(); k++)
+    for (size_t ch = 0; ch < num_channels; ch++)
+      render[k * num_channels + ch] = source[k] * channel_gains[ch];
+
+  std::vector<float> capture(delay * num_channels, 0.0f);
+  capture.insert(capture.end(), render.begin(), render.end());
+
+  return {MakeWavFileInfo(std::move(render), num_channels, sample_rate),
+          MakeWavFileInfo(std::move(capture), num_channels, sample_rate)};
+}
+
 void DelayBuffer::Delay(rtc::ArrayView<const float> x, rtc::ArrayView<float> x_delayed) {
   assert(x.size() == x_delayed.size() && "The original buffer and the delayed buffer must have the same size.");
   
@@ -30,3 +71,9 @@ void DelayBuffer::Delay(rtc::ArrayView<const float> x, rtc::ArrayView<float> x_d
   }
 }
 
+
+AlignedFilterCoefficients::AlignedFilterCoefficients(size_t size)
+    : data(webrtc::AlignedMalloc<float>(size * sizeof(float), webrtc::aec3::kMatchedFilterAlignment)),
+      size(size) {
+  std::fill(data.get(), data.get() + size, 0.0f);
+}
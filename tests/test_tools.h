@@ -2,12 +2,38 @@
 #define TEST_TOOLS_H_
 
 #include <cstddef>
+#include <memory>
 #include <vector>
 
+#include "aligned_malloc.h"
 #include "array_view.h"
+#include "webrtc_delay_estimation.h"
 
 void RandomizeSampleVector(rtc::ArrayView<float> sample);
 
+// Fills |sample| with the same random samples on every run for a given |seed|.
+void RandomizeSampleVector(rtc::ArrayView<float> sample, unsigned int seed);
+
+// Wraps interleaved samples into the structure read from a WAV file.
+webrtc_delay_estimation::WavFileInfo MakeWavFileInfo(std::vector<float> samples,
+                                                     size_t num_channels,
+                                                     int sample_rate);
+
+// Render signal and the capture signal that holds it after a delay.
+struct DelayedPair {
+  webrtc_delay_estimation::WavFileInfo render;
+  webrtc_delay_estimation::WavFileInfo capture;
+};
+
+// Returns |source| as a render signal at |sample_rate|, with one channel per
+// entry of |channel_gains| that carries |source| scaled by that gain, and a
+// capture signal that starts with |delay| frames of silence followed by the
+// same frames.
+DelayedPair MakeDelayedPair(const std::vector<float>& source,
+                            size_t delay,
+                            int sample_rate,
+                            const std::vector<float>& channel_gains = {1.f});
+
 class DelayBuffer {
   public:
     explicit DelayBuffer(size_t delay): buffer(delay) {}
@@ -20,5 +46,18 @@ class DelayBuffer {
     size_t next_insert_index = 0;
 };
 
+// Zeroed filter coefficients that are aligned like the ones of MatchedFilter.
+class AlignedFilterCoefficients {
+  public:
+    explicit AlignedFilterCoefficients(size_t size);
+    ~AlignedFilterCoefficients() = default;
+
+    rtc::ArrayView<float> View() { return rtc::ArrayView<float>(data.get(), size); }
+
+  private:
+    std::unique_ptr<float[], webrtc::AlignedFreeDeleter> data;
+    size_t size;
+};
+
 #endif
 